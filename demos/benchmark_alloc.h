@@ -0,0 +1,308 @@
+/**
+ * @file benchmark_alloc.h
+ * @brief Optional heap allocation counting for the benchmark programs
+ *
+ * When UFMT_BENCH_COUNT_ALLOCS is defined, the including program replaces the
+ * global operator new/delete and counts allocations, allocated bytes and the
+ * live/peak heap size. With UFMT_BENCH_HOOK_MALLOC also defined (glibc only),
+ * malloc/calloc/realloc/free are interposed instead, by defining them in the
+ * executable and forwarding to glibc's __libc_* entry points, so no LD_PRELOAD
+ * is needed and C allocations (e.g. inside the C library) are counted as well;
+ * operator new is then counted through malloc.
+ *
+ * Include from exactly one translation unit per program. Without
+ * UFMT_BENCH_COUNT_ALLOCS nothing is replaced and enabled() returns false.
+ *
+ * Counters are process-wide relaxed atomics: with several threads running,
+ * a scope sees the allocations of all of them.
+ */
+
+#ifndef __UFMT_BENCHMARK_ALLOC_H__
+#define __UFMT_BENCHMARK_ALLOC_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(UFMT_BENCH_HOOK_MALLOC) && !defined(__GLIBC__)
+#include <cstdio>  // pulls in features.h, which defines __GLIBC__ on glibc
+#endif
+
+#if defined(UFMT_BENCH_HOOK_MALLOC) && (!defined(__GLIBC__) || !defined(UFMT_BENCH_COUNT_ALLOCS))
+#undef UFMT_BENCH_HOOK_MALLOC
+#endif
+
+#ifdef UFMT_BENCH_HOOK_MALLOC
+#include <malloc.h>
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+#endif
+
+namespace bench_alloc {
+
+/**
+ * @brief Process-wide allocation counters at a point in time
+ */
+struct alloc_snapshot {
+    unsigned long long allocations = 0;
+    unsigned long long deallocations = 0;
+    unsigned long long bytes = 0;      // Total bytes requested
+    long long live_bytes = 0;          // Currently allocated
+    long long peak_bytes = 0;          // Maximum of live_bytes since the last reset_peak()
+};
+
+/**
+ * @brief Allocations made between construction of an alloc_scope and stop()
+ */
+struct alloc_delta {
+    unsigned long long allocations = 0;
+    unsigned long long bytes = 0;
+    long long peak_bytes = 0;          // Peak heap growth above the level at scope start
+};
+
+namespace detail {
+
+struct counters {
+    std::atomic<unsigned long long> allocations;
+    std::atomic<unsigned long long> deallocations;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<long long> live_bytes;
+    std::atomic<long long> peak_bytes;
+};
+
+// Zero-initialized before any dynamic initialization, so allocations made
+// during static construction are safe to count.
+inline counters& state() {
+    static counters instance;
+    return instance;
+}
+
+inline void record_alloc(size_t size) {
+    counters& c = state();
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    long long live = c.live_bytes.fetch_add(static_cast<long long>(size), std::memory_order_relaxed) +
+                     static_cast<long long>(size);
+    long long peak = c.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+inline void record_free(size_t size) {
+    counters& c = state();
+    c.deallocations.fetch_add(1, std::memory_order_relaxed);
+    c.live_bytes.fetch_sub(static_cast<long long>(size), std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+/**
+ * @brief Whether allocation counting is compiled in
+ */
+inline bool enabled() {
+#ifdef UFMT_BENCH_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Name of the active hook ("operator new", "malloc" or "off")
+ */
+inline const char* mode() {
+#if defined(UFMT_BENCH_HOOK_MALLOC)
+    return "malloc";
+#elif defined(UFMT_BENCH_COUNT_ALLOCS)
+    return "operator new";
+#else
+    return "off";
+#endif
+}
+
+inline alloc_snapshot snapshot() {
+    detail::counters& c = detail::state();
+    alloc_snapshot s;
+    s.allocations = c.allocations.load(std::memory_order_relaxed);
+    s.deallocations = c.deallocations.load(std::memory_order_relaxed);
+    s.bytes = c.bytes.load(std::memory_order_relaxed);
+    s.live_bytes = c.live_bytes.load(std::memory_order_relaxed);
+    s.peak_bytes = c.peak_bytes.load(std::memory_order_relaxed);
+    return s;
+}
+
+/**
+ * @brief Restart peak tracking from the current live size
+ */
+inline void reset_peak() {
+    detail::counters& c = detail::state();
+    c.peak_bytes.store(c.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Measures the allocations of a code region (resets the peak on construction)
+ */
+class alloc_scope {
+public:
+    alloc_scope() {
+        reset_peak();
+        start_ = snapshot();
+    }
+
+    alloc_delta stop() const {
+        alloc_snapshot end = snapshot();
+        alloc_delta delta;
+        delta.allocations = end.allocations - start_.allocations;
+        delta.bytes = end.bytes - start_.bytes;
+        delta.peak_bytes = end.peak_bytes - start_.live_bytes;
+        return delta;
+    }
+
+private:
+    alloc_snapshot start_;
+};
+
+} // namespace bench_alloc
+
+// ========== Replacement functions ==========
+
+#if defined(UFMT_BENCH_HOOK_MALLOC)
+
+// Definitions must repeat glibc's exception specification (__THROW).
+// Sizes are taken from malloc_usable_size() on both allocation and release so
+// the live size stays balanced; they may exceed the requested size slightly.
+extern "C" {
+
+void* malloc(size_t size) __THROW {
+    void* ptr = __libc_malloc(size);
+    if (ptr) {
+        bench_alloc::detail::record_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size) __THROW {
+    void* ptr = __libc_calloc(count, size);
+    if (ptr) {
+        bench_alloc::detail::record_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* realloc(void* old_ptr, size_t size) __THROW {
+    size_t old_size = old_ptr ? malloc_usable_size(old_ptr) : 0;
+    void* ptr = __libc_realloc(old_ptr, size);
+    if (ptr || size == 0) {
+        if (old_ptr) {
+            bench_alloc::detail::record_free(old_size);
+        }
+        if (ptr) {
+            bench_alloc::detail::record_alloc(malloc_usable_size(ptr));
+        }
+    }
+    return ptr;
+}
+
+void free(void* ptr) __THROW {
+    if (ptr) {
+        bench_alloc::detail::record_free(malloc_usable_size(ptr));
+        __libc_free(ptr);
+    }
+}
+
+} // extern "C"
+
+#elif defined(UFMT_BENCH_COUNT_ALLOCS)
+
+namespace bench_alloc {
+namespace detail {
+
+// Each block is prefixed with its size; the header keeps malloc's alignment.
+const size_t header_size = 16;
+
+inline void* counted_new(size_t size) {
+    void* block = std::malloc(size + header_size);
+    if (!block) {
+        return nullptr;
+    }
+    *static_cast<size_t*>(block) = size;
+    record_alloc(size);
+    return static_cast<char*>(block) + header_size;
+}
+
+inline void* counted_new_or_throw(size_t size) {
+    for (;;) {
+        void* ptr = counted_new(size);
+        if (ptr) {
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+inline void counted_delete(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    void* block = static_cast<char*>(ptr) - header_size;
+    record_free(*static_cast<size_t*>(block));
+    std::free(block);
+}
+
+} // namespace detail
+} // namespace bench_alloc
+
+void* operator new(size_t size) {
+    return bench_alloc::detail::counted_new_or_throw(size);
+}
+
+void* operator new[](size_t size) {
+    return bench_alloc::detail::counted_new_or_throw(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return bench_alloc::detail::counted_new(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return bench_alloc::detail::counted_new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, size_t) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    bench_alloc::detail::counted_delete(ptr);
+}
+#endif
+
+#endif // UFMT_BENCH_COUNT_ALLOCS
+
+#endif // __UFMT_BENCHMARK_ALLOC_H__
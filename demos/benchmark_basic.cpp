@@ -1,4 +1,5 @@
 #include "../include/ufmt/ufmt.h"
+#include "benchmark_alloc.h"
 #include <iostream>
 #include <chrono>
 #include <vector>
@@ -114,6 +115,26 @@ std::string format_with_ufmt_context(const TestData& data, std::unique_ptr<ufmt:
     return ctx->format("User {name} (ID: {id}) has score {score:.2f}, active: {active}");
 }
 
+// Heap allocations per call, measured over a few passes (UFMT_BENCH_COUNT_ALLOCS builds only)
+template<typename Fn>
+void print_allocations(const std::string& method_name, const std::vector<TestData>& test_data, Fn fn) {
+    const int passes = 100;
+    bench_alloc::alloc_scope scope;
+    for (int i = 0; i < passes; ++i) {
+        for (const auto& data : test_data) {
+            volatile auto result = fn(data);
+            (void)result; // Prevent optimization
+        }
+    }
+    bench_alloc::alloc_delta delta = scope.stop();
+    double calls = static_cast<double>(passes) * static_cast<double>(test_data.size());
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  " << std::left << std::setw(22) << method_name << std::right
+              << std::setw(8) << static_cast<double>(delta.allocations) / calls << " allocs/call, "
+              << std::setw(8) << static_cast<double>(delta.bytes) / calls << " bytes/call, peak "
+              << delta.peak_bytes << " bytes\n";
+}
+
 // Benchmark functions
 BenchmarkStats benchmark_sprintf(const std::vector<TestData>& test_data) {
     std::vector<double> times;
@@ -278,6 +299,16 @@ int main() {
     std::cout << "  stringstream:         " << rel(sprintf_stats.avg_ms, stringstream_stats.avg_ms) << "x\n";
     std::cout << "  ufmt (positional):    " << rel(sprintf_stats.avg_ms, ufmt_stats.avg_ms) << "x\n";
     std::cout << "  ufmt (named ctx):     " << rel(sprintf_stats.avg_ms, ufmt_context_stats.avg_ms) << "x\n";
+
+    if (bench_alloc::enabled()) {
+        std::cout << "\n=== Heap Allocations (" << bench_alloc::mode() << ") ===\n";
+        print_allocations("sprintf", test_data, format_with_sprintf);
+        print_allocations("stringstream", test_data, format_with_stringstream);
+        print_allocations("ufmt (positional)", test_data, format_with_ufmt);
+        print_allocations("ufmt (named context)", test_data, [&ctx](const TestData& data) {
+            return format_with_ufmt_context(data, ctx);
+        });
+    }
     std::cout << "\n=== Done ===\n";
     
     return 0;
@@ -1,4 +1,5 @@
 #include "../include/ufmt/ufmt.h"
+#include "../include/ufmt/ufmt_parallel.h"
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -9,6 +10,8 @@
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <tuple>
+#include <memory>
 
 // Benchmark configuration
 const int WARMUP_SECONDS = 1;
@@ -16,12 +19,98 @@ const int BENCHMARK_SECONDS = 1;       // Reduced from 2 seconds to 1 second
 const int STATISTICAL_RUNS = 2;        // Reduced from 3 to 2
 const std::vector<int> THREAD_COUNTS = {1, 2, 4}; // Keep 3 thread counts
 
+// Log-linear latency histogram in the style of HdrHistogram: values below 128 ns
+// are counted exactly, larger values in 64 sub-buckets per power of two, so
+// reported values are within 1/64 (~1.6%) of the recorded ones.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 6;
+    static const unsigned long long SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+
+    LatencyHistogram() : counts_(BUCKET_COUNT, 0), total_(0), max_(0), sum_(0) {}
+
+    void record(unsigned long long value_ns) {
+        ++counts_[index_of(value_ns)];
+        ++total_;
+        sum_ += value_ns;
+        if (value_ns > max_) max_ = value_ns;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        if (other.max_ > max_) max_ = other.max_;
+    }
+
+    // Highest value equivalent to the bucket holding the given percentile (0-100)
+    unsigned long long percentile(double p) const {
+        if (total_ == 0) return 0;
+        unsigned long long target = static_cast<unsigned long long>(std::ceil(p / 100.0 * static_cast<double>(total_)));
+        if (target == 0) target = 1;
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::min(highest_equivalent(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    unsigned long long count() const { return total_; }
+    unsigned long long max() const { return max_; }
+    double mean() const { return total_ > 0 ? static_cast<double>(sum_) / static_cast<double>(total_) : 0.0; }
+
+private:
+    std::vector<unsigned long long> counts_;
+    unsigned long long total_;
+    unsigned long long max_;
+    unsigned long long sum_;
+
+    static size_t index_of(unsigned long long value) {
+        unsigned shift = 0;
+        while ((value >> shift) >= 2 * SUB_BUCKETS) ++shift;
+        return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+    }
+
+    static unsigned long long highest_equivalent(size_t index) {
+        unsigned long long shift = index < 2 * SUB_BUCKETS ? 0 : index / SUB_BUCKETS - 1;
+        unsigned long long low = (index - shift * SUB_BUCKETS) << shift;
+        return low + (1ULL << shift) - 1;
+    }
+};
+
+// Records the time between consecutive laps, one lap per formatting operation
+class OpTimer {
+public:
+    explicit OpTimer(LatencyHistogram& histogram) : histogram_(histogram), last_(std::chrono::steady_clock::now()) {}
+
+    void lap() {
+        auto now = std::chrono::steady_clock::now();
+        histogram_.record(static_cast<unsigned long long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count()));
+        last_ = now;
+    }
+
+    void restart() { last_ = std::chrono::steady_clock::now(); }
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point last_;
+};
+
 struct ThreadBenchmarkResult {
     int thread_count;
     double ops_per_second;
     double avg_latency_us;
     long long total_operations;
     double duration_seconds;
+    LatencyHistogram latency;         // Per-operation latency, merged over all threads
+    LatencyHistogram writer_latency;  // set_var latency of the writer (mixed scenario only)
 };
 
 struct BenchmarkStats {
@@ -55,18 +144,24 @@ BenchmarkStats calculate_stats(const std::vector<double>& values) {
 
 // Worker function for benchmarking
 void benchmark_worker(int thread_id, std::atomic<bool>& running, std::atomic<long long>& operations_counter,
-                     std::chrono::steady_clock::time_point& /* start_time */) {
+                     std::chrono::steady_clock::time_point& /* start_time */, LatencyHistogram& latency) {
     auto ctx = ufmt::create_local_context();
     ctx->set_var("thread_id", thread_id);
     
     long long local_ops = 0;
+    OpTimer timer(latency);
     
     while (running.load()) {
         // Mix of different formatting operations to simulate real usage
+        timer.restart();
         volatile auto result1 = ufmt::format("Simple: {0} {1}", thread_id, local_ops);
+        timer.lap();
         volatile auto result2 = ctx->format("Named: Thread {thread_id}, Op {0}", local_ops);
+        timer.lap();
         volatile auto result3 = ufmt::format("Numeric: {0:.3f} {1:x}", static_cast<double>(local_ops) * 0.001, local_ops);
+        timer.lap();
         volatile auto result4 = ctx->format("Complex: T{thread_id} #{0} Score:{1:.2f}", local_ops, static_cast<double>(local_ops) * 0.01);
+        timer.lap();
         
         local_ops += 4;
         
@@ -79,17 +174,22 @@ void benchmark_worker(int thread_id, std::atomic<bool>& running, std::atomic<lon
 
 // Shared context worker
 void shared_context_worker(int thread_id, std::atomic<bool>& running, std::atomic<long long>& operations_counter,
-                          std::chrono::steady_clock::time_point& /* start_time */, const std::string& context_name) {
+                          std::chrono::steady_clock::time_point& /* start_time */, const std::string& context_name,
+                          LatencyHistogram& latency) {
     auto ctx = ufmt::get_shared_context(context_name);
     
     long long local_ops = 0;
+    OpTimer timer(latency);
     
     while (running.load()) {
         ctx->set_var("thread_id", thread_id);
         ctx->set_var("operation", local_ops);
         
+        timer.restart();
         volatile auto result1 = ctx->format("Shared: Thread {thread_id}, Op {operation}");
+        timer.lap();
         volatile auto result2 = ufmt::format("Mixed: {0} from shared context", thread_id);
+        timer.lap();
         
         local_ops += 2;
         
@@ -100,16 +200,66 @@ void shared_context_worker(int thread_id, std::atomic<bool>& running, std::atomi
     operations_counter += local_ops;
 }
 
+// Reader of the mixed scenario: formats with variables owned by the main thread,
+// so every lookup takes the shared context mutex while the writer updates them
+void mixed_reader_worker(int thread_id, std::atomic<bool>& running, std::atomic<long long>& operations_counter,
+                         const std::string& context_name, LatencyHistogram& latency) {
+    auto ctx = ufmt::get_shared_context(context_name);
+    
+    long long local_ops = 0;
+    OpTimer timer(latency);
+    
+    while (running.load()) {
+        timer.restart();
+        volatile auto result = ctx->format("[{level}] {service} reader {0} op {1}", thread_id, local_ops);
+        timer.lap();
+        ++local_ops;
+        (void)result; // Prevent optimization
+    }
+    
+    operations_counter += local_ops;
+}
+
+ThreadBenchmarkResult finish_result(int num_threads, long long total_operations,
+                                    std::chrono::steady_clock::time_point start_time,
+                                    std::chrono::steady_clock::time_point end_time,
+                                    const std::vector<std::unique_ptr<LatencyHistogram>>& histograms) {
+    auto actual_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+    double duration_sec = static_cast<double>(actual_duration.count()) / 1000000.0;
+    
+    ThreadBenchmarkResult result;
+    result.thread_count = num_threads;
+    result.total_operations = total_operations;
+    result.duration_seconds = duration_sec;
+    result.ops_per_second = static_cast<double>(result.total_operations) / duration_sec;
+    result.avg_latency_us = (duration_sec * 1000000.0) / static_cast<double>(result.total_operations);
+    for (const auto& histogram : histograms) {
+        result.latency.merge(*histogram);
+    }
+    return result;
+}
+
+// One histogram per thread, allocated separately so threads do not share cache lines
+std::vector<std::unique_ptr<LatencyHistogram>> make_histograms(int num_threads) {
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    for (int i = 0; i < num_threads; ++i) {
+        histograms.emplace_back(new LatencyHistogram());
+    }
+    return histograms;
+}
+
 ThreadBenchmarkResult run_local_context_benchmark(int num_threads, int duration_seconds) {
     std::atomic<bool> running{false};
     std::atomic<long long> operations_counter{0};
     std::vector<std::thread> threads;
+    auto histograms = make_histograms(num_threads);
     
     auto start_time = std::chrono::steady_clock::now();
     
     // Start worker threads
     for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back(benchmark_worker, i, std::ref(running), std::ref(operations_counter), std::ref(start_time));
+        threads.emplace_back(benchmark_worker, i, std::ref(running), std::ref(operations_counter), std::ref(start_time),
+                             std::ref(*histograms[static_cast<size_t>(i)]));
     }
     
     // Start the benchmark
@@ -128,30 +278,21 @@ ThreadBenchmarkResult run_local_context_benchmark(int num_threads, int duration_
         t.join();
     }
     
-    auto actual_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    double duration_sec = static_cast<double>(actual_duration.count()) / 1000000.0;
-    
-    ThreadBenchmarkResult result;
-    result.thread_count = num_threads;
-    result.total_operations = operations_counter.load();
-    result.duration_seconds = duration_sec;
-    result.ops_per_second = static_cast<double>(result.total_operations) / duration_sec;
-    result.avg_latency_us = (duration_sec * 1000000.0) / static_cast<double>(result.total_operations);
-    
-    return result;
+    return finish_result(num_threads, operations_counter.load(), start_time, end_time, histograms);
 }
 
 ThreadBenchmarkResult run_shared_context_benchmark(int num_threads, int duration_seconds) {
     std::atomic<bool> running{false};
     std::atomic<long long> operations_counter{0};
     std::vector<std::thread> threads;
+    auto histograms = make_histograms(num_threads);
     
     auto start_time = std::chrono::steady_clock::now();
     
     // Start worker threads (all sharing the same context)
     for (int i = 0; i < num_threads; ++i) {
         threads.emplace_back(shared_context_worker, i, std::ref(running), std::ref(operations_counter), 
-                           std::ref(start_time), "shared_benchmark");
+                           std::ref(start_time), "shared_benchmark", std::ref(*histograms[static_cast<size_t>(i)]));
     }
     
     // Start the benchmark
@@ -170,19 +311,159 @@ ThreadBenchmarkResult run_shared_context_benchmark(int num_threads, int duration
         t.join();
     }
     
-    auto actual_duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    double duration_sec = static_cast<double>(actual_duration.count()) / 1000000.0;
+    return finish_result(num_threads, operations_counter.load(), start_time, end_time, histograms);
+}
+
+// Mixed readers/writers: num_threads readers format with shared variables while
+// the main thread keeps updating them (set_var from the main thread writes the
+// shared storage under the context mutex)
+ThreadBenchmarkResult run_mixed_benchmark(int num_threads, int duration_seconds) {
+    const std::string context_name = "mixed_benchmark";
+    auto ctx = ufmt::get_shared_context(context_name);
+    ctx->set_var("level", "INFO");
+    ctx->set_var("service", "orders");
     
-    ThreadBenchmarkResult result;
+    std::atomic<bool> running{false};
+    std::atomic<long long> operations_counter{0};
+    std::vector<std::thread> threads;
+    auto histograms = make_histograms(num_threads);
+    
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(mixed_reader_worker, i, std::ref(running), std::ref(operations_counter),
+                             std::cref(context_name), std::ref(*histograms[static_cast<size_t>(i)]));
+    }
+    
+    LatencyHistogram writer_latency;
+    OpTimer timer(writer_latency);
+    const char* levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+    auto start_time = std::chrono::steady_clock::now();
+    auto stop_time = start_time + std::chrono::seconds(duration_seconds);
+    running = true;
+    
+    // Writer loop on the main thread, paced so readers still get the lock
+    unsigned writes = 0;
+    while (std::chrono::steady_clock::now() < stop_time) {
+        timer.restart();
+        ctx->set_var("level", levels[writes % 4]);
+        timer.lap();
+        ++writes;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    
+    running = false;
+    auto end_time = std::chrono::steady_clock::now();
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    ThreadBenchmarkResult result = finish_result(num_threads, operations_counter.load(), start_time, end_time, histograms);
+    result.writer_latency = writer_latency;
+    return result;
+}
+
+// Percentile table of merged per-operation latencies (nanoseconds)
+void print_latency_table(const std::string& title, const std::vector<ThreadBenchmarkResult>& results, bool writers = false) {
+    std::cout << "\n[" << title << "]\nThreads  |  Samples      |  Mean ns  |  p50 ns  |  p99 ns  |  p99.9 ns  |  Max ns" << std::endl;
+    for (const auto& r : results) {
+        const LatencyHistogram& h = writers ? r.writer_latency : r.latency;
+        std::cout << std::setw(7) << r.thread_count << "  |  " << std::setw(11) << h.count()
+                  << "  |  " << std::setw(7) << std::fixed << std::setprecision(0) << h.mean()
+                  << "  |  " << std::setw(6) << h.percentile(50.0)
+                  << "  |  " << std::setw(6) << h.percentile(99.0)
+                  << "  |  " << std::setw(8) << h.percentile(99.9)
+                  << "  |  " << h.max() << std::endl;
+    }
+}
+
+// Parallel batch formatting on a work-stealing pool with skewed row costs
+const std::vector<size_t> POOL_THREAD_COUNTS = {1, 2, 4, 8, 16, 32, 64};
+const int BATCH_ROWS = 200000;
+
+typedef std::vector<std::tuple<int, std::string, double, std::string>> BatchRows;
+
+struct PoolBenchmarkResult {
+    size_t thread_count;
+    double rows_per_second;
+    double static_rows_per_second;
+    double steals_per_job;
+};
+
+// Baseline without load balancing: one contiguous range per worker, so the
+// slowest range decides the time of the whole job
+void static_format_batch(ufmt::task_pool& pool, ufmt::format_context_base& ctx, const ufmt::compiled_template& tmpl,
+                         const BatchRows& rows, ufmt::chunked_output& out) {
+    typedef ufmt::detail::batch_plan<BatchRows::value_type, ufmt::batch_output> Plan;
+    size_t chunk_count = pool.thread_count();
+    std::vector<Plan> plans(chunk_count, Plan(ctx, tmpl));
+    out.reset(chunk_count);
+    pool.run(chunk_count, [&](size_t chunk, size_t worker) {
+        size_t begin = rows.size() * chunk / chunk_count;
+        size_t end = rows.size() * (chunk + 1) / chunk_count;
+        plans[worker].write_rows(rows.begin() + static_cast<std::ptrdiff_t>(begin),
+                                 rows.begin() + static_cast<std::ptrdiff_t>(end), out.chunk(chunk));
+    });
+}
+
+// Repeats format_job for at least 0.5s, returns rows per second
+template<typename Job>
+double time_batch_jobs(size_t row_count, Job format_job, int& iterations) {
+    auto start_time = std::chrono::steady_clock::now();
+    iterations = 0;
+    double elapsed = 0.0;
+    do {
+        format_job();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    } while (elapsed < 0.5);
+    return static_cast<double>(row_count) * iterations / elapsed;
+}
+
+PoolBenchmarkResult run_parallel_batch_benchmark(size_t num_threads, const BatchRows& rows) {
+    static const auto tmpl = ufmt::compile("{0},{1},{2:.4f},{3}\n");
+    auto ctx = ufmt::create_local_context();
+    ufmt::task_pool pool(num_threads);
+    ufmt::chunked_output out;
+    PoolBenchmarkResult result;
     result.thread_count = num_threads;
-    result.total_operations = operations_counter.load();
-    result.duration_seconds = duration_sec;
-    result.ops_per_second = static_cast<double>(result.total_operations) / duration_sec;
-    result.avg_latency_us = (duration_sec * 1000000.0) / static_cast<double>(result.total_operations);
+    int iterations = 0;
+    
+    auto static_job = [&]() { static_format_batch(pool, *ctx, *tmpl, rows, out); };
+    static_job();  // Warm up buffers and threads
+    result.static_rows_per_second = time_batch_jobs(rows.size(), static_job, iterations);
     
+    auto stealing_job = [&]() { ufmt::parallel_format_batch(pool, *ctx, *tmpl, rows, out); };
+    stealing_job();
+    // steal_count() is cumulative, so only count the steals of the timed jobs
+    unsigned long long steals_before = pool.steal_count();
+    result.rows_per_second = time_batch_jobs(rows.size(), stealing_job, iterations);
+    result.steals_per_job = static_cast<double>(pool.steal_count() - steals_before) / iterations;
     return result;
 }
 
+void run_parallel_batch_benchmarks() {
+    // The first eighth of the rows carries large payloads, so equal-sized
+    // contiguous ranges differ in cost and static chunking leaves workers idle
+    BatchRows rows;
+    rows.reserve(BATCH_ROWS);
+    for (int i = 0; i < BATCH_ROWS; ++i) {
+        size_t note_length = (i < BATCH_ROWS / 8) ? 4096 : 8;
+        rows.emplace_back(i, "user" + std::to_string(i % 1000), i * 0.125, std::string(note_length, 'n'));
+    }
+    
+    std::cout << "\n[Parallel Batch, work-stealing pool vs static chunks, " << BATCH_ROWS << " skewed rows]\n"
+              << "Threads  |  Rows/sec      |  Speedup  |  Static rows/sec  |  Speedup  |  Steals/job" << std::endl;
+    double baseline = 0.0;
+    for (size_t thread_count : POOL_THREAD_COUNTS) {
+        auto r = run_parallel_batch_benchmark(thread_count, rows);
+        if (baseline == 0.0) baseline = r.rows_per_second;
+        std::cout << std::setw(7) << r.thread_count << "  |  " << std::setw(12) << std::fixed << std::setprecision(0)
+                  << r.rows_per_second << "  |  " << std::setw(7) << std::setprecision(2) << r.rows_per_second / baseline
+                  << "x |  " << std::setw(16) << std::setprecision(0) << r.static_rows_per_second
+                  << "  |  " << std::setw(7) << std::setprecision(2) << r.static_rows_per_second / baseline
+                  << "x |  " << std::setprecision(1) << r.steals_per_job << std::endl;
+    }
+}
+
 int main() {
     std::cout << "=== ufmt Multi-threading Benchmark ===\n";
     std::cout << "Config: "
@@ -195,6 +476,10 @@ int main() {
     }
     std::cout << ", HW: " << std::thread::hardware_concurrency() << std::endl << std::endl;
     
+    // Claim the shared context main thread before any worker runs, so the mixed
+    // scenario's writer updates the shared (mutex-protected) storage
+    ufmt::get_shared_context("mixed_benchmark")->set_var("level", "INFO");
+    
     // Warmup
     run_local_context_benchmark(2, WARMUP_SECONDS);
     
@@ -207,6 +492,7 @@ int main() {
             auto result = run_local_context_benchmark(thread_count, BENCHMARK_SECONDS);
             ops_per_sec_runs.push_back(result.ops_per_second);
             if (run == 0) local_results.push_back(result);
+            else local_results.back().latency.merge(result.latency);
         }
         auto stats = calculate_stats(ops_per_sec_runs);
         local_results.back().ops_per_second = stats.avg_ops;
@@ -217,6 +503,7 @@ int main() {
     for (const auto& r : local_results) {
         std::cout << std::setw(7) << r.thread_count << "  |  " << std::fixed << std::setprecision(0) << r.ops_per_second << std::endl;
     }
+    print_latency_table("Local Contexts: Latency", local_results);
     // Benchmark 2: Shared Context Performance
     std::vector<ThreadBenchmarkResult> shared_results;
     double baseline_shared_ops = 0.0;
@@ -226,6 +513,7 @@ int main() {
             auto result = run_shared_context_benchmark(thread_count, BENCHMARK_SECONDS);
             ops_per_sec_runs.push_back(result.ops_per_second);
             if (run == 0) shared_results.push_back(result);
+            else shared_results.back().latency.merge(result.latency);
         }
         auto stats = calculate_stats(ops_per_sec_runs);
         shared_results.back().ops_per_second = stats.avg_ops;
@@ -236,12 +524,36 @@ int main() {
     for (const auto& r : shared_results) {
         std::cout << std::setw(7) << r.thread_count << "  |  " << std::fixed << std::setprecision(0) << r.ops_per_second << std::endl;
     }
+    print_latency_table("Shared Contexts: Latency", shared_results);
     // Print summary ratio
     std::cout << "\n[Summary: Local/Shared Ratio]\nThreads  |  Ratio (L/Sh)" << std::endl;
     for (size_t i = 0; i < local_results.size() && i < shared_results.size(); ++i) {
         double ratio = local_results[i].ops_per_second / shared_results[i].ops_per_second;
         std::cout << std::setw(7) << local_results[i].thread_count << "  |  " << std::fixed << std::setprecision(2) << ratio << "x" << std::endl;
     }
+    // Benchmark 3: Mixed readers/writers on one shared context
+    std::vector<ThreadBenchmarkResult> mixed_results;
+    for (int thread_count : THREAD_COUNTS) {
+        for (int run = 0; run < STATISTICAL_RUNS; ++run) {
+            auto result = run_mixed_benchmark(thread_count, BENCHMARK_SECONDS);
+            if (run == 0) {
+                mixed_results.push_back(result);
+            } else {
+                mixed_results.back().latency.merge(result.latency);
+                mixed_results.back().writer_latency.merge(result.writer_latency);
+                mixed_results.back().ops_per_second += result.ops_per_second;
+            }
+        }
+        mixed_results.back().ops_per_second /= STATISTICAL_RUNS;
+    }
+    std::cout << "\n[Mixed Readers/Writer, shared context]\nReaders  |  Avg Ops/sec" << std::endl;
+    for (const auto& r : mixed_results) {
+        std::cout << std::setw(7) << r.thread_count << "  |  " << std::fixed << std::setprecision(0) << r.ops_per_second << std::endl;
+    }
+    print_latency_table("Mixed: Reader Latency", mixed_results);
+    print_latency_table("Mixed: Writer set_var Latency (main thread)", mixed_results, true);
+    // Benchmark 4: Parallel batch scaling
+    run_parallel_batch_benchmarks();
     std::cout << "\n=== Done ===\n";
     return 0;
 }
@@ -0,0 +1,221 @@
+/**
+ * @file benchmark_perf.h
+ * @brief Hardware performance counters for the benchmark programs (Linux)
+ *
+ * perf_counters opens one perf_event_open counter per event for the calling
+ * thread (user space only): instructions, cycles, branch misses, L1 data cache
+ * read misses, last level cache misses and context switches. Each counter is
+ * opened on its own, so an event the CPU or the virtual machine does not offer
+ * is simply reported as unavailable, and multiplexed counters are scaled by
+ * their enabled/running times.
+ *
+ * When perf_event_open is not permitted (see /proc/sys/kernel/perf_event_paranoid),
+ * not supported, or on other platforms, available() returns false and status()
+ * explains why; samples are then empty.
+ */
+
+#ifndef __UFMT_BENCHMARK_PERF_H__
+#define __UFMT_BENCHMARK_PERF_H__
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace bench_perf {
+
+enum counter_id {
+    instructions,
+    cycles,
+    branch_misses,
+    l1d_misses,
+    llc_misses,
+    context_switches,
+    counter_count
+};
+
+inline const char* counter_name(int id) {
+    static const char* names[] = {
+        "instructions", "cycles", "branch_misses", "l1d_misses", "llc_misses", "context_switches"
+    };
+    return id >= 0 && id < counter_count ? names[id] : "";
+}
+
+/**
+ * @brief Counter deltas between perf_counters::start() and stop()
+ */
+struct perf_sample {
+    double values[counter_count];
+    bool valid[counter_count];
+
+    perf_sample() {
+        for (int i = 0; i < counter_count; ++i) {
+            values[i] = 0.0;
+            valid[i] = false;
+        }
+    }
+
+    bool has(counter_id id) const { return valid[id]; }
+
+    bool has_ipc() const { return valid[instructions] && valid[cycles]; }
+
+    // Instructions per cycle, 0 if either counter is unavailable
+    double ipc() const {
+        return valid[instructions] && valid[cycles] && values[cycles] > 0 ? values[instructions] / values[cycles] : 0.0;
+    }
+};
+
+#if defined(__linux__)
+
+class perf_counters {
+public:
+    perf_counters() : available_(false) {
+        int first_errno = 0;
+        for (int i = 0; i < counter_count; ++i) {
+            fds_[i] = open_counter(static_cast<counter_id>(i));
+            if (fds_[i] >= 0) {
+                available_ = true;
+            } else if (first_errno == 0) {
+                first_errno = errno;
+            }
+        }
+        if (available_) {
+            status_ = "perf_event_open";
+            for (int i = 0; i < counter_count; ++i) {
+                if (fds_[i] < 0) {
+                    status_ += std::string(", ") + counter_name(i) + " unavailable";
+                }
+            }
+        } else if (first_errno == EACCES || first_errno == EPERM) {
+            status_ = "not permitted (lower /proc/sys/kernel/perf_event_paranoid or grant CAP_PERFMON)";
+        } else {
+            status_ = std::string("unavailable (") + std::strerror(first_errno) + ")";
+        }
+    }
+
+    ~perf_counters() {
+        for (int i = 0; i < counter_count; ++i) {
+            if (fds_[i] >= 0) {
+                close(fds_[i]);
+            }
+        }
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const { return available_; }
+    const std::string& status() const { return status_; }
+
+    void start() {
+        for (int i = 0; i < counter_count; ++i) {
+            if (fds_[i] >= 0) {
+                ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    perf_sample stop() {
+        perf_sample sample;
+        for (int i = 0; i < counter_count; ++i) {
+            if (fds_[i] >= 0) {
+                ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (int i = 0; i < counter_count; ++i) {
+            // value, time enabled, time running (PERF_FORMAT_TOTAL_TIME_*)
+            uint64_t data[3];
+            if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+                continue;
+            }
+            if (data[2] == 0) {
+                continue;  // Never scheduled on the PMU
+            }
+            double scale = data[2] < data[1] ? static_cast<double>(data[1]) / static_cast<double>(data[2]) : 1.0;
+            sample.values[i] = static_cast<double>(data[0]) * scale;
+            sample.valid[i] = true;
+        }
+        return sample;
+    }
+
+private:
+    int fds_[counter_count];
+    bool available_;
+    std::string status_;
+
+    static int open_counter(counter_id id) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch (id) {
+        case instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case branch_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case l1d_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case llc_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case context_switches:
+            // Counted by the kernel; retried below if kernel events are refused
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            attr.exclude_kernel = 0;
+            break;
+        default:
+            return -1;
+        }
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0 && attr.exclude_kernel == 0 && (errno == EACCES || errno == EPERM)) {
+            attr.exclude_kernel = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        return fd;
+    }
+};
+
+#else
+
+class perf_counters {
+public:
+    perf_counters() : status_("unavailable (Linux only)") {}
+
+    bool available() const { return false; }
+    const std::string& status() const { return status_; }
+    void start() {}
+    perf_sample stop() { return perf_sample(); }
+
+private:
+    std::string status_;
+};
+
+#endif
+
+} // namespace bench_perf
+
+#endif // __UFMT_BENCHMARK_PERF_H__
@@ -0,0 +1,540 @@
+#include "../include/ufmt/ufmt.h"
+#include "benchmark_alloc.h"
+#include "benchmark_perf.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+
+// Micro-benchmark suite: isolated benchmarks per formatting kernel and feature,
+// each across template sizes / argument counts.
+//
+// Usage: benchmark_suite [--format=table|json|csv] [--output=FILE]
+//                        [--filter=SUBSTRING] [--min-time-ms=N] [--repetitions=N]
+//                        [--max-allocs-per-op=N] [--perf]
+//
+// Built with UFMT_BENCH_COUNT_ALLOCS (CMake option UFMT_BENCHMARK_COUNT_ALLOCS)
+// every benchmark also reports heap allocations and bytes per call and the peak
+// heap growth, see benchmark_alloc.h. --max-allocs-per-op then makes the run fail
+// when a selected benchmark allocates more often, to enforce allocation budgets.
+//
+// --perf adds hardware counters per benchmark on Linux (instructions, cycles,
+// branch misses, L1d/LLC misses, context switches; see benchmark_perf.h), reported
+// as IPC and counts per call. Without permission the suite runs without them.
+
+// Benchmark configuration (defaults, see command line options)
+const int DEFAULT_MIN_TIME_MS = 50;    // Minimum measured time per sample
+const int DEFAULT_REPETITIONS = 5;     // Samples per benchmark, the median is reported
+
+struct SuiteOptions {
+    std::string format = "table";
+    std::string output;
+    std::string filter;
+    int min_time_ms = DEFAULT_MIN_TIME_MS;
+    int repetitions = DEFAULT_REPETITIONS;
+    double max_allocs_per_op = -1;     // Negative: no limit
+    bool perf = false;                 // Collect hardware counters
+};
+
+struct BenchmarkResult {
+    std::string group;      // Kernel or feature
+    std::string name;       // Variant within the group
+    size_t size;            // Template size, width or variable count (0 if not applicable)
+    size_t args;            // Arguments per call
+    size_t iterations;      // Calls per sample
+    double ns_per_op;       // Median over samples
+    double min_ns_per_op;
+    double max_ns_per_op;
+    double allocs_per_op;   // Allocation counters, only with bench_alloc::enabled()
+    double bytes_per_op;
+    long long peak_bytes;   // Peak heap growth during the samples
+    bench_perf::perf_sample perf;  // Counter totals over all samples, only with --perf
+    double calls;           // Calls over all samples
+};
+
+// Results must be consumed, otherwise the compiler may drop the formatting
+static volatile size_t g_sink_bytes = 0;
+
+inline void consume(const std::string& value) {
+    g_sink_bytes = g_sink_bytes + value.size();
+}
+
+class BenchmarkSuite {
+public:
+    explicit BenchmarkSuite(const SuiteOptions& options) : options_(options) {
+        if (options_.perf) {
+            perf_.reset(new bench_perf::perf_counters());
+            if (!perf_->available()) {
+                perf_.reset();
+            }
+        }
+    }
+
+    // Hardware counters are collected (requested and permitted)
+    bool perf_enabled() const { return perf_ != nullptr; }
+
+    std::string perf_status() const { return perf_ ? perf_->status() : std::string("off"); }
+
+    /**
+     * Run op repeatedly: the iteration count is calibrated so one sample takes at
+     * least min_time_ms, then the median of the samples is recorded.
+     */
+    void run(const std::string& group, const std::string& name, size_t size, size_t args,
+             const std::function<void()>& op) {
+        std::string full_name = group + "/" + name + "/" + std::to_string(size);
+        if (!options_.filter.empty() && full_name.find(options_.filter) == std::string::npos) {
+            return;
+        }
+
+        // Warmup and calibration
+        size_t iterations = 1;
+        for (;;) {
+            double elapsed = time_ns(op, iterations);
+            if (elapsed >= options_.min_time_ms * 1e6 || iterations >= (size_t(1) << 30)) {
+                break;
+            }
+            double scale = elapsed > 0 ? options_.min_time_ms * 1e6 / elapsed : 100.0;
+            iterations = static_cast<size_t>(static_cast<double>(iterations) * std::min(std::max(scale * 1.2, 2.0), 100.0));
+        }
+
+        std::vector<double> samples;
+        samples.reserve(static_cast<size_t>(options_.repetitions));  // Keep out of the allocation counts
+        bench_alloc::alloc_scope allocs;
+        if (perf_) {
+            perf_->start();
+        }
+        for (int i = 0; i < options_.repetitions; ++i) {
+            samples.push_back(time_ns(op, iterations) / static_cast<double>(iterations));
+        }
+        bench_perf::perf_sample counters = perf_ ? perf_->stop() : bench_perf::perf_sample();
+        bench_alloc::alloc_delta delta = allocs.stop();
+        double calls = static_cast<double>(iterations) * options_.repetitions;
+        std::sort(samples.begin(), samples.end());
+
+        BenchmarkResult result;
+        result.group = group;
+        result.name = name;
+        result.size = size;
+        result.args = args;
+        result.iterations = iterations;
+        result.ns_per_op = samples[samples.size() / 2];
+        result.min_ns_per_op = samples.front();
+        result.max_ns_per_op = samples.back();
+        result.allocs_per_op = static_cast<double>(delta.allocations) / calls;
+        result.bytes_per_op = static_cast<double>(delta.bytes) / calls;
+        result.peak_bytes = delta.peak_bytes;
+        result.perf = counters;
+        result.calls = calls;
+        results_.push_back(result);
+        if (options_.max_allocs_per_op >= 0 && bench_alloc::enabled() &&
+            result.allocs_per_op > options_.max_allocs_per_op) {
+            over_budget_.push_back(full_name);
+        }
+
+        if (options_.format == "table") {
+            print_row(std::cout, result);
+        } else {
+            std::cerr << "  " << full_name << ": " << std::fixed << std::setprecision(1)
+                      << result.ns_per_op << " ns/op";
+            if (bench_alloc::enabled()) {
+                std::cerr << ", " << result.allocs_per_op << " allocs/op";
+            }
+            if (perf_ && result.perf.has_ipc()) {
+                std::cerr << ", IPC " << std::setprecision(2) << result.perf.ipc();
+            }
+            std::cerr << std::endl;
+        }
+    }
+
+    const std::vector<BenchmarkResult>& results() const { return results_; }
+
+    // Benchmarks exceeding --max-allocs-per-op
+    const std::vector<std::string>& over_budget() const { return over_budget_; }
+
+    void print_header(std::ostream& out) const {
+        out << std::left << std::setw(18) << "group" << std::setw(26) << "name"
+            << std::right << std::setw(8) << "size" << std::setw(6) << "args"
+            << std::setw(14) << "ns/op" << std::setw(14) << "min" << std::setw(14) << "max"
+            << std::setw(14) << "Mops/s";
+        if (bench_alloc::enabled()) {
+            out << std::setw(12) << "allocs/op" << std::setw(12) << "bytes/op" << std::setw(12) << "peak";
+        }
+        if (perf_) {
+            out << std::setw(8) << "IPC" << std::setw(12) << "instr/op" << std::setw(12) << "cycles/op"
+                << std::setw(12) << "brmiss/op" << std::setw(12) << "L1dmiss/op" << std::setw(12) << "LLCmiss/op"
+                << std::setw(8) << "ctxsw";
+        }
+        out << "\n";
+    }
+
+    void print_row(std::ostream& out, const BenchmarkResult& r) const {
+        out << std::left << std::setw(18) << r.group << std::setw(26) << r.name
+            << std::right << std::setw(8) << r.size << std::setw(6) << r.args
+            << std::fixed << std::setprecision(1)
+            << std::setw(14) << r.ns_per_op << std::setw(14) << r.min_ns_per_op << std::setw(14) << r.max_ns_per_op
+            << std::setprecision(3) << std::setw(14) << (r.ns_per_op > 0 ? 1000.0 / r.ns_per_op : 0.0);
+        if (bench_alloc::enabled()) {
+            out << std::setprecision(2) << std::setw(12) << r.allocs_per_op << std::setprecision(1)
+                << std::setw(12) << r.bytes_per_op << std::setw(12) << r.peak_bytes;
+        }
+        if (perf_) {
+            out << std::setprecision(2) << std::setw(8);
+            if (r.perf.has_ipc()) {
+                out << r.perf.ipc();
+            } else {
+                out << "n/a";
+            }
+            const bench_perf::counter_id per_op[] = {bench_perf::instructions, bench_perf::cycles, bench_perf::branch_misses,
+                                                     bench_perf::l1d_misses, bench_perf::llc_misses};
+            for (bench_perf::counter_id id : per_op) {
+                if (r.perf.has(id)) {
+                    out << std::setw(12) << r.perf.values[id] / r.calls;
+                } else {
+                    out << std::setw(12) << "n/a";
+                }
+            }
+            if (r.perf.has(bench_perf::context_switches)) {
+                out << std::setprecision(0) << std::setw(8) << r.perf.values[bench_perf::context_switches];
+            } else {
+                out << std::setw(8) << "n/a";
+            }
+        }
+        out << std::endl;
+    }
+
+    void write_json(std::ostream& out) const {
+        out << "{\"benchmarks\":[\n";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const BenchmarkResult& r = results_[i];
+            out << "  " << ufmt::format(
+                "{{\"group\":\"{0!json}\",\"name\":\"{1!json}\",\"size\":{2},\"args\":{3},"
+                "\"iterations\":{4},\"ns_per_op\":{5:.2f},\"min_ns_per_op\":{6:.2f},\"max_ns_per_op\":{7:.2f}",
+                r.group, r.name, r.size, r.args, r.iterations, r.ns_per_op, r.min_ns_per_op, r.max_ns_per_op);
+            if (bench_alloc::enabled()) {
+                out << ufmt::format(",\"allocs_per_op\":{0:.3f},\"bytes_per_op\":{1:.1f},\"peak_bytes\":{2}",
+                                    r.allocs_per_op, r.bytes_per_op, r.peak_bytes);
+            }
+            if (perf_) {
+                if (r.perf.has_ipc()) {
+                    out << ufmt::format(",\"ipc\":{0:.3f}", r.perf.ipc());
+                }
+                for (int id = 0; id < bench_perf::counter_count; ++id) {
+                    if (r.perf.valid[id]) {
+                        out << ufmt::format(",\"{0}_per_op\":{1:.4f}", bench_perf::counter_name(id), r.perf.values[id] / r.calls);
+                    }
+                }
+            }
+            out << "}";
+            out << (i + 1 < results_.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+    }
+
+    void write_csv(std::ostream& out) const {
+        out << "group,name,size,args,iterations,ns_per_op,min_ns_per_op,max_ns_per_op";
+        out << (bench_alloc::enabled() ? ",allocs_per_op,bytes_per_op,peak_bytes" : "");
+        if (perf_) {
+            out << ",ipc";
+            for (int id = 0; id < bench_perf::counter_count; ++id) {
+                out << "," << bench_perf::counter_name(id) << "_per_op";
+            }
+        }
+        out << "\n";
+        for (const auto& r : results_) {
+            out << ufmt::format("{0!csv},{1!csv},{2},{3},{4},{5:.2f},{6:.2f},{7:.2f}",
+                                r.group, r.name, r.size, r.args, r.iterations,
+                                r.ns_per_op, r.min_ns_per_op, r.max_ns_per_op);
+            if (bench_alloc::enabled()) {
+                out << ufmt::format(",{0:.3f},{1:.1f},{2}", r.allocs_per_op, r.bytes_per_op, r.peak_bytes);
+            }
+            if (perf_) {
+                out << (r.perf.has_ipc() ? ufmt::format(",{0:.3f}", r.perf.ipc()) : std::string(","));
+                for (int id = 0; id < bench_perf::counter_count; ++id) {
+                    // Unavailable counters are left empty
+                    out << (r.perf.valid[id] ? ufmt::format(",{0:.4f}", r.perf.values[id] / r.calls) : std::string(","));
+                }
+            }
+            out << "\n";
+        }
+    }
+
+private:
+    SuiteOptions options_;
+    std::vector<BenchmarkResult> results_;
+    std::vector<std::string> over_budget_;
+    std::unique_ptr<bench_perf::perf_counters> perf_;
+
+    static double time_ns(const std::function<void()>& op, size_t iterations) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+};
+
+// ========== Template generators ==========
+
+// Template with `placeholders` positional placeholders {0}..{args-1} separated by short literals
+std::string make_positional_template(size_t placeholders, size_t args) {
+    std::string tmpl;
+    for (size_t i = 0; i < placeholders; ++i) {
+        tmpl += "field " + std::to_string(i) + "={" + std::to_string(i % args) + "} ";
+    }
+    return tmpl;
+}
+
+// Mostly literal text of about `size` bytes with two placeholders near the ends
+std::string make_sparse_template(size_t size) {
+    std::string tmpl = "start {0} ";
+    const char* filler = "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+    while (tmpl.size() + 10 < size) {
+        tmpl += filler;
+    }
+    tmpl.resize(size > 10 ? size - 10 : 0);
+    tmpl += " end {1}";
+    return tmpl;
+}
+
+// Template referencing `count` named variables v0..v{count-1}
+std::string make_named_template(size_t count) {
+    std::string tmpl;
+    for (size_t i = 0; i < count; ++i) {
+        tmpl += "v" + std::to_string(i) + "={v" + std::to_string(i) + "} ";
+    }
+    return tmpl;
+}
+
+struct Point {
+    int x;
+    int y;
+};
+
+// ========== Benchmarks ==========
+
+void bench_parsing(BenchmarkSuite& suite) {
+    const size_t counts[] = {1, 4, 16, 64};
+    for (size_t count : counts) {
+        std::string tmpl = make_positional_template(count, 4);
+        suite.run("parse", "compile_positional", count, 0, [&tmpl]() {
+            ufmt::compiled_template compiled(tmpl);
+            g_sink_bytes = g_sink_bytes + compiled.segments().size();
+        });
+    }
+    const size_t sizes[] = {256, 4096, 65536};
+    for (size_t size : sizes) {
+        std::string tmpl = make_sparse_template(size);
+        suite.run("parse", "compile_sparse", size, 0, [&tmpl]() {
+            ufmt::compiled_template compiled(tmpl);
+            g_sink_bytes = g_sink_bytes + compiled.segments().size();
+        });
+    }
+}
+
+void bench_integers(BenchmarkSuite& suite) {
+    const long long values[] = {7, 123456, 9223372036854775807LL};
+    const char* names[] = {"small", "medium", "large"};
+    for (size_t i = 0; i < 3; ++i) {
+        long long value = values[i];
+        std::string name = names[i];
+        suite.run("integer", "default_" + name, 0, 1, [value]() { consume(ufmt::format("{0}", value)); });
+        suite.run("integer", "hex_" + name, 0, 1, [value]() { consume(ufmt::format("{0:x}", value)); });
+        suite.run("integer", "grouped_" + name, 0, 1, [value]() { consume(ufmt::format("{0:,d}", value)); });
+        suite.run("integer", "binary_" + name, 0, 1, [value]() { consume(ufmt::format("{0:b}", value)); });
+    }
+    const size_t widths[] = {8, 32};
+    for (size_t width : widths) {
+        std::string tmpl = "{0:0" + std::to_string(width) + "d}";
+        suite.run("integer", "zero_padded", width, 1, [&tmpl]() { consume(ufmt::format(tmpl, 4242)); });
+    }
+}
+
+void bench_floats(BenchmarkSuite& suite) {
+    const double value = 12345.6789;
+    suite.run("float", "default", 0, 1, [value]() { consume(ufmt::format("{0}", value)); });
+    suite.run("float", "fixed_2", 0, 1, [value]() { consume(ufmt::format("{0:.2f}", value)); });
+    suite.run("float", "scientific", 0, 1, [value]() { consume(ufmt::format("{0:.3e}", value)); });
+    suite.run("float", "grouped_2", 0, 1, [value]() { consume(ufmt::format("{0:,.2f}", value)); });
+    suite.run("float", "centered_2", 12, 1, [value]() { consume(ufmt::format("{0:^12.2f}", value)); });
+}
+
+void bench_strings(BenchmarkSuite& suite) {
+    const std::string value = "benchmark value";
+    const size_t widths[] = {8, 64, 256};
+    for (size_t width : widths) {
+        std::string right = "{0:" + std::to_string(width) + "}";
+        std::string left = "{0:-" + std::to_string(width) + "}";
+        std::string center = "{0:*^" + std::to_string(width) + "}";
+        suite.run("string_pad", "right", width, 1, [&right, &value]() { consume(ufmt::format(right, value)); });
+        suite.run("string_pad", "left", width, 1, [&left, &value]() { consume(ufmt::format(left, value)); });
+        suite.run("string_pad", "center_fill", width, 1, [&center, &value]() { consume(ufmt::format(center, value)); });
+    }
+    suite.run("string_pad", "truncate", 8, 1, [&value]() { consume(ufmt::format("{0:.8}", value)); });
+    suite.run("string_pad", "none", 0, 1, [&value]() { consume(ufmt::format("{0}", value)); });
+}
+
+void bench_named_lookup(BenchmarkSuite& suite) {
+    const size_t counts[] = {1, 8, 64};
+    for (size_t count : counts) {
+        std::string tmpl = make_named_template(count);
+        auto local = ufmt::create_local_context();
+        auto arena = ufmt::create_arena_context();
+        auto shared = ufmt::create_shared_context();
+        for (size_t i = 0; i < count; ++i) {
+            std::string name = "v" + std::to_string(i);
+            local->set_var(name, static_cast<int>(i));
+            arena->set_var(name, static_cast<int>(i));
+            shared->set_var(name, static_cast<int>(i));
+        }
+        // Contexts are kept alive by the closures
+        std::shared_ptr<ufmt::local_context> local_ptr(std::move(local));
+        std::shared_ptr<ufmt::arena_context> arena_ptr(std::move(arena));
+        std::shared_ptr<ufmt::shared_context> shared_ptr(std::move(shared));
+        suite.run("named_lookup", "local", count, 0, [local_ptr, tmpl]() { consume(local_ptr->format(tmpl)); });
+        suite.run("named_lookup", "arena", count, 0, [arena_ptr, tmpl]() { consume(arena_ptr->format(tmpl)); });
+        suite.run("named_lookup", "shared", count, 0, [shared_ptr, tmpl]() { consume(shared_ptr->format(tmpl)); });
+    }
+}
+
+void bench_custom_formatters(BenchmarkSuite& suite) {
+    std::shared_ptr<ufmt::local_context> ctx(ufmt::create_local_context());
+    ctx->set_formatter<Point>([](const Point& p) {
+        return "(" + std::to_string(p.x) + ", " + std::to_string(p.y) + ")";
+    });
+    Point point{10, 20};
+    suite.run("custom_formatter", "local", 0, 1, [ctx, point]() { consume(ctx->format("at {0}", point)); });
+    suite.run("custom_formatter", "builtin_int", 0, 1, [ctx]() { consume(ctx->format("at {0}", 10)); });
+}
+
+void bench_positional(BenchmarkSuite& suite) {
+    const size_t placeholder_counts[] = {4, 16, 64};
+    for (size_t count : placeholder_counts) {
+        std::string tmpl1 = make_positional_template(count, 1);
+        std::string tmpl2 = make_positional_template(count, 2);
+        std::string tmpl4 = make_positional_template(count, 4);
+        std::string tmpl8 = make_positional_template(count, 8);
+        suite.run("positional", "args_1", count, 1, [&tmpl1]() { consume(ufmt::format(tmpl1, 1)); });
+        suite.run("positional", "args_2", count, 2, [&tmpl2]() { consume(ufmt::format(tmpl2, 1, "two")); });
+        suite.run("positional", "args_4", count, 4, [&tmpl4]() {
+            consume(ufmt::format(tmpl4, 1, "two", 3.0, true));
+        });
+        suite.run("positional", "args_8", count, 8, [&tmpl8]() {
+            consume(ufmt::format(tmpl8, 1, "two", 3.0, true, 5u, '6', 7LL, std::string("eight")));
+        });
+        auto compiled = ufmt::compile(tmpl4);
+        suite.run("positional", "compiled_capture_4", count, 4, [compiled]() {
+            consume(ufmt::capture(*compiled, 1, "two", 3.0, true).str());
+        });
+    }
+}
+
+void bench_literal_heavy(BenchmarkSuite& suite) {
+    const size_t sizes[] = {64, 1024, 16384, 262144};
+    for (size_t size : sizes) {
+        std::string tmpl = make_sparse_template(size);
+        suite.run("literal_heavy", "format", size, 2, [&tmpl]() { consume(ufmt::format(tmpl, 1, "x")); });
+        auto compiled = ufmt::compile(tmpl);
+        suite.run("literal_heavy", "compiled_capture", size, 2, [compiled]() {
+            consume(ufmt::capture(*compiled, 1, "x").str());
+        });
+    }
+}
+
+bool parse_options(int argc, char** argv, SuiteOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value_of = [&arg](const char* prefix) { return arg.substr(std::strlen(prefix)); };
+        if (arg.compare(0, 9, "--format=") == 0) {
+            options.format = value_of("--format=");
+        } else if (arg.compare(0, 9, "--output=") == 0) {
+            options.output = value_of("--output=");
+        } else if (arg.compare(0, 9, "--filter=") == 0) {
+            options.filter = value_of("--filter=");
+        } else if (arg.compare(0, 14, "--min-time-ms=") == 0) {
+            options.min_time_ms = std::max(1, std::atoi(value_of("--min-time-ms=").c_str()));
+        } else if (arg.compare(0, 14, "--repetitions=") == 0) {
+            options.repetitions = std::max(1, std::atoi(value_of("--repetitions=").c_str()));
+        } else if (arg.compare(0, 20, "--max-allocs-per-op=") == 0) {
+            options.max_allocs_per_op = std::atof(value_of("--max-allocs-per-op=").c_str());
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n"
+                      << "Usage: benchmark_suite [--format=table|json|csv] [--output=FILE] [--filter=SUBSTRING]"
+                         " [--min-time-ms=N] [--repetitions=N] [--max-allocs-per-op=N] [--perf]" << std::endl;
+            return false;
+        }
+    }
+    if (options.format != "table" && options.format != "json" && options.format != "csv") {
+        std::cerr << "Unknown format: " << options.format << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    SuiteOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+    BenchmarkSuite suite(options);
+    if (options.perf && !suite.perf_enabled()) {
+        std::cerr << "Hardware counters " << bench_perf::perf_counters().status() << ", continuing without them" << std::endl;
+    }
+    if (options.format == "table") {
+        std::cout << "=== ufmt Benchmark Suite ===" << std::endl;
+        std::cout << "Configuration: " << options.repetitions << " samples of >= " << options.min_time_ms
+                  << " ms per benchmark, median reported" << std::endl;
+        std::cout << "Allocation counting: " << bench_alloc::mode() << std::endl;
+        std::cout << "Hardware counters: " << suite.perf_status() << std::endl << std::endl;
+        suite.print_header(std::cout);
+    }
+
+    bench_parsing(suite);
+    bench_integers(suite);
+    bench_floats(suite);
+    bench_strings(suite);
+    bench_named_lookup(suite);
+    bench_custom_formatters(suite);
+    bench_positional(suite);
+    bench_literal_heavy(suite);
+
+    if (options.format != "table") {
+        std::ofstream file;
+        if (!options.output.empty()) {
+            file.open(options.output.c_str());
+            if (!file) {
+                std::cerr << "Cannot open " << options.output << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& out = options.output.empty() ? std::cout : file;
+        if (options.format == "json") {
+            suite.write_json(out);
+        } else {
+            suite.write_csv(out);
+        }
+    }
+
+    if (options.max_allocs_per_op >= 0 && !bench_alloc::enabled()) {
+        std::cerr << "--max-allocs-per-op ignored: built without UFMT_BENCH_COUNT_ALLOCS" << std::endl;
+    }
+    if (!suite.over_budget().empty()) {
+        std::cerr << "Allocation budget of " << options.max_allocs_per_op << " per call exceeded by:" << std::endl;
+        for (const auto& name : suite.over_budget()) {
+            std::cerr << "  " << name << std::endl;
+        }
+        return 1;
+    }
+    return 0;
+}
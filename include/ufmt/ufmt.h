@@ -68,11 +68,54 @@
 #include <typeinfo>
 #include <typeindex>
 #include <memory>
+#include <new>
+#if !defined(UFMT_SEPARATE_COMPILATION)
 #include <thread>
+#endif
 #include <mutex>
+#if defined(UFMT_ENABLE_LOCK_STATS) || defined(UFMT_ENABLE_PROFILING)
+#include <chrono>
+#endif
 #include <cstdio>
 #include <cctype>
 #include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <tuple>
+#include <iterator>
+#include <atomic>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// SIMD template scanning, disable with UFMT_NO_SIMD
+#if !defined(UFMT_NO_SIMD)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UFMT_SIMD_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__)
+#define UFMT_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define UFMT_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+// Build mode: header-only by default. With UFMT_SEPARATE_COMPILATION the
+// non-template functions below are only declared and compiled once into a
+// library (src/ufmt.cpp, CMake target ufmt_static); see ufmt_impl.h.
+#if defined(UFMT_SEPARATE_COMPILATION)
+#define UFMT_DECL
+#else
+#define UFMT_DECL inline
+#endif
 
 /**
  * @namespace ufmt
@@ -109,6 +152,7 @@ namespace ufmt {
 
 class context_base;
 class local_context;
+class arena_context;
 class shared_context;
 
 // ========== Exception Classes ==========
@@ -145,15 +189,34 @@ public:
 
 // ========== Format Specification ==========
 
+/**
+ * @brief How string width and truncation specs ({0:10}, {0:.8}) measure text
+ * @ingroup formatting
+ *
+ * Selected per placeholder with the U (code points) or W (display columns)
+ * spec flag, e.g. {0:<W20}.
+ */
+enum class width_mode {
+    bytes,       ///< One unit per byte (default, fastest)
+    codepoints,  ///< One unit per UTF-8 code point; sequences are never split
+    columns      ///< Terminal display columns: East Asian wide characters count 2, combining marks 0
+};
+
 /**
  * @brief Parsed format specification for a placeholder
  * @ingroup formatting
  *
  * Format specification syntax (for placeholders in template strings):
- *   [{alignment}]{width}[.{precision}]{type}
+ *   [[{fill}]{alignment}][{sign}][U|W][#][0]{width}[{grouping}][.{precision}]{type}
  *
- * - alignment: '-' (left), '^' (center), default (right)
- * - width: minimum field width (pads with spaces if needed)
+ * - fill: any character other than '{' or '}', must be followed by an alignment (default space)
+ * - alignment: '-' or '<' (left), '^' (center), '>' or default (right)
+ * - sign: '+' (always) or ' ' (space for non-negative numbers)
+ * - U / W: measure text width and truncation in UTF-8 code points / display columns instead of bytes
+ * - #: alternate form (0x/0X prefix for hex, 0b/0B for binary, leading 0 for octal)
+ * - 0: pad numbers with zeros after the sign (right alignment only)
+ * - width: minimum field width (pads with the fill character if needed)
+ * - grouping: ',' or '_' after the width separates integer digits in groups (3 decimal, 4 binary/octal/hex)
  * - .precision: for strings, truncates to max length (adds ellipsis if >3); for numbers, sets decimal precision
  * - type: 'f', 'd', 'x', etc. (printf-style type specifier)
  *
@@ -165,15 +228,22 @@ public:
  *   {val:08x}         // zero-padded, width 8, hex integer
  *   {num:10.2f}       // right-aligned, width 10, 2 decimal float
  *   {s:^12.5}         // center, width 12, truncate to 5 chars
+ *   {title:*^20}      // center, width 20, padded with '*'
+ *   {city:<W12}       // left-aligned, 12 display columns (CJK counts 2)
  */
 struct FormatSpec {
-    std::string name;           ///< Variable name or positional index
     std::string format_string;  ///< Format specification (e.g., ".2f", "08x")
     int width = 0;              ///< Field width
     int precision = -1;         ///< Decimal precision or string truncation
     bool left_justify = false;  ///< Left justification flag
     char format_type = '\0';    ///< Format type (f, d, x, etc.)
     bool zero_pad = false;      ///< Zero padding flag
+    char fill = ' ';            ///< Padding character
+    char align = '\0';          ///< '<' left, '>' right, '^' center, '\0' default (right)
+    char sign = '\0';           ///< '+', ' ' or '\0' (only negative numbers get a sign)
+    bool alternate = false;     ///< Alternate form ('#')
+    char grouping = '\0';       ///< Digit group separator (',' or '_') or '\0'
+    width_mode width_unit = width_mode::bytes;  ///< How width and truncation measure text ('U', 'W' flags)
 };
 
 // ========== Optional ustr.h Integration ==========
@@ -186,6 +256,98 @@ struct FormatSpec {
 // with a clear error indicating that ustr.h needs to be included
 #endif
 
+// ========== Text Width ==========
+
+namespace detail {
+
+/**
+ * @brief Length of the leading pure-ASCII run of [data, data + size)
+ *
+ * Checks 16 bytes per step with SSE2 or NEON where available.
+ */
+inline size_t ascii_prefix_length(const char* data, size_t size) {
+    size_t i = 0;
+#if defined(UFMT_SIMD_SSE2)
+    for (; size - i >= 16; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))) != 0) {
+            break;
+        }
+    }
+#elif defined(UFMT_SIMD_NEON)
+    for (; size - i >= 16; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i))) >= 0x80) {
+            break;
+        }
+    }
+#endif
+    while (i < size && static_cast<unsigned char>(data[i]) < 0x80) {
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * @brief Decode one UTF-8 sequence starting at p (p < end)
+ * @return Sequence length; malformed input yields one byte decoded as U+FFFD
+ */
+inline size_t decode_utf8(const char* p, const char* end, uint32_t& codepoint) {
+    unsigned char lead = static_cast<unsigned char>(*p);
+    size_t length = lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    uint32_t value = lead < 0xE0 ? (lead & 0x1Fu) : lead < 0xF0 ? (lead & 0x0Fu) : (lead & 0x07u);
+    if (lead < 0xC2 || lead > 0xF4 || static_cast<size_t>(end - p) < length) {
+        codepoint = 0xFFFD;
+        return 1;
+    }
+    for (size_t i = 1; i < length; ++i) {
+        unsigned char next = static_cast<unsigned char>(p[i]);
+        if ((next & 0xC0) != 0x80) {
+            codepoint = 0xFFFD;
+            return 1;
+        }
+        value = (value << 6) | (next & 0x3Fu);
+    }
+    codepoint = value;
+    return length;
+}
+
+/**
+ * @brief Display columns of a non-ASCII code point (0, 1 or 2)
+ */
+inline size_t codepoint_columns(uint32_t cp) {
+    // Combining marks, zero width space/joiners and variation selectors
+    if ((cp >= 0x0300 && cp <= 0x036F) || (cp >= 0x1AB0 && cp <= 0x1AFF) || (cp >= 0x1DC0 && cp <= 0x1DFF) ||
+        (cp >= 0x200B && cp <= 0x200F) || (cp >= 0x20D0 && cp <= 0x20FF) || (cp >= 0xFE00 && cp <= 0xFE0F) ||
+        (cp >= 0xFE20 && cp <= 0xFE2F)) {
+        return 0;
+    }
+    // East Asian Wide and Fullwidth ranges, emoji
+    if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0x303E) || (cp >= 0x3041 && cp <= 0x33FF) ||
+        (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0xA000 && cp <= 0xA4CF) ||
+        (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFE30 && cp <= 0xFE4F) ||
+        (cp >= 0xFF00 && cp <= 0xFF60) || (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1F64F) ||
+        (cp >= 0x1F900 && cp <= 0x1F9FF) || (cp >= 0x20000 && cp <= 0x3FFFD)) {
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * @brief Width of text in the given mode
+ */
+UFMT_DECL size_t text_width(const char* data, size_t size, width_mode mode);
+
+/**
+ * @brief Byte length of the longest prefix of text at most max_width wide
+ *
+ * Multi-byte sequences are never split outside of width_mode::bytes; in
+ * width_mode::columns a wide character that does not fit is left out.
+ *
+ * @param prefix_width Set to the width of the returned prefix
+ */
+UFMT_DECL size_t text_prefix(const char* data, size_t size, size_t max_width, width_mode mode, size_t& prefix_width);
+
+} // namespace detail
+
 // ========== Type System ==========
 
 namespace detail {
@@ -328,390 +490,2719 @@ inline std::string to_string_impl<char*>(char* const& value) {
 
 // ========== Formatting Functions (adapted from dlog.h) ==========
 
+template<typename Sink>
+class escaping_sink;
+
 /**
- * @brief Format double value with printf-style format specification
+ * @brief Append count copies of a fill character without allocating
  */
-inline std::string format_double_value(double value, const std::string& formatSpec) {
-    if (formatSpec.empty()) {
-        return std::to_string(value);
+template<typename Sink>
+void append_fill(Sink& sink, char fill, size_t count) {
+    char block[32];
+    std::memset(block, fill, sizeof(block));
+    while (count > 0) {
+        size_t chunk = std::min(count, sizeof(block));
+        sink.append(block, chunk);
+        count -= chunk;
     }
-    
-    char buffer[256];
-    std::string printfFormat = "%" + formatSpec;
-    snprintf(buffer, sizeof(buffer), printfFormat.c_str(), value);
-    return std::string(buffer);
 }
 
 /**
- * @brief Format integer value with printf-style format specification
+ * @brief Reserve room for extra bytes in sinks that support it
+ */
+template<typename Sink>
+void reserve_extra(Sink& /* sink */, size_t /* extra */) {}
+
+inline void reserve_extra(std::string& sink, size_t extra) {
+    sink.reserve(sink.size() + extra);
+}
+
+inline bool is_align_char(char c) {
+    return c == '<' || c == '>' || c == '^' || c == '-';
+}
+
+/**
+ * @brief Parse a format specification into a FormatSpec
+ *
+ * Syntax: [[fill]align][sign][U|W][#][0][width][grouping][.precision][type]. printf length
+ * modifiers (l, ll, h, ...) before the type are accepted and ignored. This is
+ * the only place spec text is parsed; compiled templates keep the result.
+ */
+UFMT_DECL FormatSpec parse_format_spec(const char* spec, size_t length);
+
+inline FormatSpec parse_format_spec(const std::string& spec) {
+    return parse_format_spec(spec.data(), spec.length());
+}
+
+inline bool is_float_type(char type) {
+    return type != '\0' && std::strchr("fFeEgGaA", type) != nullptr;
+}
+
+inline bool is_integer_type(char type) {
+    return type != '\0' && std::strchr("diuxXobBc", type) != nullptr;
+}
+
+/**
+ * @brief Write text with truncation, alignment and fill straight into a sink
+ *
+ * Reserves the final size once (when the sink supports it); padding is written
+ * from a stack buffer, so no temporaries are allocated.
+ *
+ * @param precision Maximum width, longer text is cut (with "..." if precision > 3); negative for none
+ * @param mode Unit of width and precision
+ */
+template<typename Sink>
+void append_padded(Sink& sink, const char* data, size_t size, char fill, char align, int width, int precision,
+                   width_mode mode) {
+    size_t keep = size;
+    size_t value_width = text_width(data, size, mode);
+    bool ellipsis = false;
+    if (precision > 0 && value_width > static_cast<size_t>(precision)) {
+        if (precision <= 3) {
+            // For very short precision, just take first N characters without ellipsis
+            keep = text_prefix(data, size, static_cast<size_t>(precision), mode, value_width);
+        } else {
+            keep = text_prefix(data, size, static_cast<size_t>(precision - 3), mode, value_width);
+            value_width += 3;
+            ellipsis = true;
+        }
+    }
+    size_t field = width > 0 ? static_cast<size_t>(width) : 0;
+    size_t padding = field > value_width ? field - value_width : 0;
+    size_t left = align == '<' ? 0 : align == '^' ? padding / 2 : padding;
+    reserve_extra(sink, keep + (ellipsis ? 3 : 0) + padding);
+    append_fill(sink, fill, left);
+    sink.append(data, keep);
+    if (ellipsis) {
+        sink.append("...", 3);
+    }
+    append_fill(sink, fill, padding - left);
+}
+
+/**
+ * @brief Write a string value formatted with spec (alignment, fill, width, truncation)
  */
-inline std::string format_integer_value(long long value, const std::string& formatSpec) {
-    if (formatSpec.empty()) {
-        return std::to_string(value);
+template<typename Sink>
+void append_aligned(Sink& sink, const char* data, size_t size, const FormatSpec& spec) {
+    append_padded(sink, data, size, spec.fill, spec.align, spec.width, spec.precision, spec.width_unit);
+}
+
+template<typename Sink>
+void append_integer(Sink& sink, unsigned long long magnitude, bool negative, const FormatSpec& spec);
+
+template<typename Sink>
+void append_number_layout(Sink& sink, const char* prefix, size_t prefix_length,
+                          const char* digits, size_t digit_count, size_t min_digits,
+                          bool zero_fill, unsigned group, const FormatSpec& spec,
+                          const char* suffix, size_t suffix_length);
+
+/**
+ * @brief Write a floating point value formatted with spec
+ *
+ * Digits come from snprintf with a format built from the parsed spec. Right
+ * alignment with spaces or zeros is left to printf, other alignments and fill
+ * characters are applied afterwards. With grouping the separators are inserted
+ * into the integer part while the number is laid out, so no locale is involved.
+ * Integer types truncate the value.
+ */
+template<typename Sink>
+void append_double(Sink& sink, double value, const FormatSpec& spec) {
+    char type = spec.format_type;
+    if (is_integer_type(type) && value > -9.2e18 && value < 9.2e18) {
+        long long integral = static_cast<long long>(value);
+        append_integer(sink, integral < 0 ? 0ULL - static_cast<unsigned long long>(integral)
+                                          : static_cast<unsigned long long>(integral),
+                       integral < 0, spec);
+        return;
     }
-    
-    // Check for binary format (b or B)
-    if (!formatSpec.empty() && (formatSpec.back() == 'b' || formatSpec.back() == 'B')) {
-        // Handle binary formatting
-        if (value == 0) {
-            return "0b0";
+    if (!is_float_type(type)) {
+        type = 'f';
+    }
+    bool native_pad = spec.align == '\0' && spec.fill == ' ' && spec.grouping == '\0';
+    char format[12];
+    char* f = format;
+    *f++ = '%';
+    if (spec.sign != '\0') {
+        *f++ = spec.sign;
+    }
+    if (spec.alternate) {
+        *f++ = '#';
+    }
+    if (native_pad && spec.zero_pad) {
+        *f++ = '0';
+    }
+    std::memcpy(f, "*.*", 3);
+    f += 3;
+    *f++ = type;
+    *f = '\0';
+    int width = native_pad ? spec.width : 0;
+
+    char buffer[512];  // "%f" of DBL_MAX needs 316 characters
+    int length = snprintf(buffer, sizeof(buffer), format, width, spec.precision, value);
+    if (length < 0) {
+        return;
+    }
+    std::string large;
+    const char* text = buffer;
+    if (static_cast<size_t>(length) >= sizeof(buffer)) {
+        large.resize(static_cast<size_t>(length) + 1);
+        snprintf(&large[0], large.size(), format, width, spec.precision, value);
+        text = large.data();
+    }
+    const char* stop = text + length;
+    if (native_pad) {
+        sink.append(text, static_cast<size_t>(length));
+        return;
+    }
+    if (spec.grouping != '\0') {
+        // Split "[sign]digits[.fraction|exponent]"; inf and nan have no digits
+        const char* digits = text;
+        if (*digits == '-' || *digits == '+' || *digits == ' ') {
+            ++digits;
         }
-        
-        std::string binary;
-        unsigned long long uval = static_cast<unsigned long long>(value);
-        
-        // Convert to binary
-        while (uval > 0) {
-            binary = (uval & 1 ? '1' : '0') + binary;
-            uval >>= 1;
+        const char* rest = digits;
+        while (rest < stop && *rest >= '0' && *rest <= '9') {
+            ++rest;
         }
-        
-        // Apply width padding if specified
-        std::string widthSpec = formatSpec.substr(0, formatSpec.length() - 1);
-        if (!widthSpec.empty()) {
-            try {
-                int width = std::stoi(widthSpec);
-                if (width > static_cast<int>(binary.length() + 2)) { // +2 for "0b"
-                    int padding = width - static_cast<int>(binary.length()) - 2;
-                    if (widthSpec[0] == '0') {
-                        // Zero padding after "0b"
-                        binary = std::string(static_cast<size_t>(padding), '0') + binary;
-                    } else {
-                        // Space padding before "0b"
-                        return std::string(static_cast<size_t>(padding), ' ') + "0b" + binary;
-                    }
-                }
-            } catch (const std::exception&) {
-                // Invalid width specification, ignore
+        if (rest > digits) {
+            append_number_layout(sink, text, static_cast<size_t>(digits - text),
+                                 digits, static_cast<size_t>(rest - digits), 0,
+                                 spec.zero_pad && spec.align == '\0', 3, spec,
+                                 rest, static_cast<size_t>(stop - rest));
+            return;
+        }
+    }
+    append_padded(sink, text, static_cast<size_t>(length), spec.fill, spec.align, spec.width, -1, width_mode::bytes);
+}
+
+/**
+ * @brief Number of significant bits of a non-zero value (count-leading-zeros)
+ */
+inline unsigned bit_width(unsigned long long value) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index) + 1;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32))) {
+        return static_cast<unsigned>(index) + 33;
+    }
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+    return static_cast<unsigned>(index) + 1;
+#else
+    return 64u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+/**
+ * @brief Table of the 8 binary digits of every byte value
+ */
+struct binary_digits_table {
+    char digits[256][8];
+
+    binary_digits_table() {
+        for (unsigned byte = 0; byte < 256; ++byte) {
+            for (unsigned bit = 0; bit < 8; ++bit) {
+                digits[byte][bit] = (byte & (0x80u >> bit)) ? '1' : '0';
             }
         }
-        
-        return "0b" + binary;
     }
-    
-    char buffer[256];
-    std::string printfFormat = "%" + formatSpec;
-    snprintf(buffer, sizeof(buffer), printfFormat.c_str(), value);
-    return std::string(buffer);
+};
+
+inline const binary_digits_table& binary_digits() {
+    static const binary_digits_table table;
+    return table;
 }
 
 /**
- * @brief Applies width, alignment, and truncation to a string value according to formatSpec.
- *
- * Format spec syntax: [alignment][width][.precision]
- *   - alignment: '-' (left), '^' (center), default (right)
- *   - width: minimum field width (pads with spaces)
- *   - .precision: for strings, truncates to max length (ellipsis if >3)
- *
- * Examples:
- *   {name:10}    // right-aligned, width 10
- *   {name:-10}   // left-aligned, width 10
- *   {name:^10}   // center-aligned, width 10
- *   {msg:.8}     // truncate string to 8 chars
- *   {s:^12.5}    // center, width 12, truncate to 5 chars
+ * @brief Write the binary digits of value ending at end, return the first digit
  *
- * @param value String value to format
- * @param formatSpec Format specification string
- * @return Formatted string
+ * The digit count comes from count-leading-zeros; each byte is copied from a
+ * lookup table, eight digits at a time.
  */
-inline std::string apply_string_formatting(const std::string& value, const std::string& formatSpec) {
-    if (formatSpec.empty()) {
-        return value;
+inline char* write_binary_digits(char* end, unsigned long long value) {
+    if (value == 0) {
+        *--end = '0';
+        return end;
     }
-    
-    // Parse format spec: [alignment][width][.precision]
-    // alignment: '-' (left), '^' (center), default (right)
-    // width: field width
-    // precision: max characters (truncate with ellipsis if longer)
-    
-    bool leftJustified = false;
-    bool centerJustified = false;
-    int width = 0;
-    int maxLen = -1;
-    
-    std::string spec = formatSpec;
-    size_t pos = 0;
-    
-    // Parse alignment
-    if (!spec.empty() && (spec[0] == '-' || spec[0] == '^')) {
-        if (spec[0] == '-') {
-            leftJustified = true;
-        } else if (spec[0] == '^') {
-            centerJustified = true;
-        }
-        pos = 1;
+    const binary_digits_table& table = binary_digits();
+    unsigned bits = bit_width(value);
+    char* begin = end - bits;
+    unsigned top = bits % 8 == 0 ? 8 : bits % 8;
+    unsigned shift = bits - top;
+    std::memcpy(begin, table.digits[(value >> shift) & 0xFF] + (8 - top), top);
+    char* p = begin + top;
+    while (shift > 0) {
+        shift -= 8;
+        std::memcpy(p, table.digits[(value >> shift) & 0xFF], 8);
+        p += 8;
     }
-    
-    // Parse width and precision
-    size_t dotPos = spec.find('.', pos);
-    if (dotPos != std::string::npos) {
-        // Has precision specifier - for strings this means truncation
-        if (dotPos > pos) {
-            width = std::atoi(spec.substr(pos, dotPos - pos).c_str());
+    return begin;
+}
+
+/**
+ * @brief Write sign/prefix, digits and suffix with zero extension, digit grouping and alignment
+ *
+ * @param min_digits Digits are zero-extended to this count
+ * @param zero_fill Zero-extend to fill the field width (counting separators)
+ * @param group Digits per group when spec.grouping is set
+ * @param suffix Text after the digits (fraction and exponent of a floating point value)
+ */
+template<typename Sink>
+void append_number_layout(Sink& sink, const char* prefix, size_t prefix_length,
+                          const char* digits, size_t digit_count, size_t min_digits,
+                          bool zero_fill, unsigned group, const FormatSpec& spec,
+                          const char* suffix, size_t suffix_length) {
+    size_t width = spec.width > 0 ? static_cast<size_t>(spec.width) : 0;
+    size_t total = std::max(digit_count, min_digits);
+    char separator = spec.grouping;
+    // Characters of n digits including separators
+    auto grouped = [separator, group](size_t n) { return separator ? n + (n - 1) / group : n; };
+    if (zero_fill) {
+        while (prefix_length + grouped(total) + suffix_length < width) {
+            ++total;
         }
-        maxLen = std::atoi(spec.substr(dotPos + 1).c_str());
+    }
+    size_t body = prefix_length + grouped(total) + suffix_length;
+    size_t padding = width > body ? width - body : 0;
+    size_t left = spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
+    reserve_extra(sink, body + padding);
+    append_fill(sink, spec.fill, left);
+    sink.append(prefix, prefix_length);
+    if (!separator) {
+        append_fill(sink, '0', total - digit_count);
+        sink.append(digits, digit_count);
     } else {
-        // Only width, no truncation
-        if (pos < spec.length()) {
-            width = std::atoi(spec.substr(pos).c_str());
+        // Assemble groups in a stack buffer (heap only for very wide fields)
+        char local[160];
+        std::string heap;
+        size_t length = grouped(total);
+        char* out = local;
+        if (length > sizeof(local)) {
+            heap.resize(length);
+            out = &heap[0];
         }
-    }
-    
-    // Apply truncation with ellipsis if needed (only when .precision is explicitly specified)
-    std::string processedValue = value;
-    if (maxLen > 0 && static_cast<int>(value.length()) > maxLen) {
-        if (maxLen <= 3) {
-            // For very short precision, just take first N characters without ellipsis
-            processedValue = value.substr(0, static_cast<std::string::size_type>(maxLen));
-        } else {
-            // For longer precision, truncate and add ellipsis
-            processedValue = value.substr(0, static_cast<std::string::size_type>(maxLen - 3)) + "...";
+        char* p = out + length;
+        for (size_t i = 0; i < total; ++i) {
+            if (i > 0 && i % group == 0) {
+                *--p = separator;
+            }
+            *--p = i < digit_count ? digits[digit_count - 1 - i] : '0';
         }
+        sink.append(out, length);
     }
-    
-    // Apply width and justification
-    if (width <= 0 || width <= static_cast<int>(processedValue.length())) {
-        return processedValue;
+    sink.append(suffix, suffix_length);
+    append_fill(sink, spec.fill, padding - left);
+}
+
+/**
+ * @brief Write an integer with sign, base prefix, precision (minimum digits), zero padding and alignment
+ *
+ * Types: d/i/u decimal, x/X hexadecimal, o octal, b/B binary, c character;
+ * floating point types format the value as a double. '#' adds the base prefix
+ * (0x/0X, 0b/0B, leading 0 for octal) to non-zero values. The magnitude is
+ * written after the sign; append_signed_integer() passes negative x/X/o/u
+ * values as two's complement instead.
+ */
+template<typename Sink>
+void append_integer(Sink& sink, unsigned long long magnitude, bool negative, const FormatSpec& spec) {
+    char type = spec.format_type;
+    if (is_float_type(type)) {
+        double value = static_cast<double>(magnitude);
+        append_double(sink, negative ? -value : value, spec);
+        return;
     }
-    
-    int padding = width - static_cast<int>(processedValue.length());
-    
-    if (leftJustified) {
-        return processedValue + std::string(static_cast<size_t>(padding), ' ');
-    } else if (centerJustified) {
-        int leftPad = padding / 2;
-        int rightPad = padding - leftPad;
-        return std::string(static_cast<size_t>(leftPad), ' ') + processedValue + 
-               std::string(static_cast<size_t>(rightPad), ' ');
+    if (type == 'c') {
+        char c = static_cast<char>(magnitude);
+        append_aligned(sink, &c, 1, spec);
+        return;
+    }
+    bool zero = magnitude == 0;
+    char digits[64];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    unsigned group = 4;
+    if (type == 'b' || type == 'B') {
+        p = write_binary_digits(end, magnitude);
     } else {
-        // Right justified (default)
-        return std::string(static_cast<size_t>(padding), ' ') + processedValue;
+        unsigned base = 10;
+        const char* alphabet = "0123456789abcdef";
+        switch (type) {
+        case 'x': base = 16; break;
+        case 'X': base = 16; alphabet = "0123456789ABCDEF"; break;
+        case 'o': base = 8; break;
+        default: group = 3; break;
+        }
+        do {
+            *--p = alphabet[magnitude % base];
+            magnitude /= base;
+        } while (magnitude != 0);
+    }
+    size_t digit_count = static_cast<size_t>(end - p);
+
+    char prefix[3];
+    size_t prefix_length = 0;
+    if (negative) {
+        prefix[prefix_length++] = '-';
+    } else if (spec.sign != '\0') {
+        prefix[prefix_length++] = spec.sign;
+    }
+    // Precision is the minimum digit count, only with an explicit type (plain {0:.3} has no effect)
+    size_t min_digits = spec.precision > 0 && type != '\0' ? static_cast<size_t>(spec.precision) : 0;
+    if (spec.alternate && (type == 'x' || type == 'X' || type == 'b' || type == 'B') && !zero) {
+        prefix[prefix_length++] = '0';
+        prefix[prefix_length++] = type;
+    } else if (spec.alternate && type == 'o' && !zero) {
+        min_digits = std::max(min_digits, digit_count + 1);
     }
+    // Zero padding goes between sign/prefix and digits; like printf, not with a precision
+    bool zero_fill = spec.zero_pad && spec.align == '\0' && spec.precision < 0;
+    append_number_layout(sink, prefix, prefix_length, p, digit_count, min_digits, zero_fill, group, spec, "", 0);
 }
 
 /**
- * @brief Default format function for various types
+ * @brief Append a value formatted with a parsed spec to a sink
+ *
+ * Arithmetic values, strings and booleans are written directly into the sink,
+ * other types are converted with to_string_impl() and aligned.
  */
-template<typename T>
-std::string format_value(const T& value, const std::string& formatSpec) {
-    return apply_string_formatting(to_string_impl(value), formatSpec);
+template<typename Sink, typename T>
+void append_formatted(Sink& sink, const T& value, const FormatSpec& spec) {
+    std::string text = to_string_impl(value);
+    append_aligned(sink, text.data(), text.length(), spec);
 }
 
-// Specializations for numeric types
-template<>
-inline std::string format_value<float>(const float& value, const std::string& formatSpec) {
-    return format_double_value(static_cast<double>(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const std::string& value, const FormatSpec& spec) {
+    append_aligned(sink, value.data(), value.length(), spec);
 }
 
-template<>
-inline std::string format_value<double>(const double& value, const std::string& formatSpec) {
-    return format_double_value(value, formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const char* const& value, const FormatSpec& spec) {
+    append_aligned(sink, value, std::strlen(value), spec);
 }
 
-template<>
-inline std::string format_value<int>(const int& value, const std::string& formatSpec) {
-    return format_integer_value(static_cast<long long>(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, char* const& value, const FormatSpec& spec) {
+    append_aligned(sink, value, std::strlen(value), spec);
 }
 
-template<>
-inline std::string format_value<long>(const long& value, const std::string& formatSpec) {
-    return format_integer_value(static_cast<long long>(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const bool& value, const FormatSpec& spec) {
+    append_aligned(sink, value ? "true" : "false", value ? 4 : 5, spec);
 }
 
-template<>
-inline std::string format_value<long long>(const long long& value, const std::string& formatSpec) {
-    return format_integer_value(value, formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const char& value, const FormatSpec& spec) {
+    // Integer types print the character code
+    if (spec.format_type != 'c' && is_integer_type(spec.format_type)) {
+        append_integer(sink, static_cast<unsigned long long>(static_cast<unsigned char>(value)), false, spec);
+    } else {
+        append_aligned(sink, &value, 1, spec);
+    }
 }
 
-template<>
-inline std::string format_value<unsigned int>(const unsigned int& value, const std::string& formatSpec) {
-    return format_integer_value(static_cast<long long>(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const double& value, const FormatSpec& spec) {
+    append_double(sink, value, spec);
 }
 
-template<>
-inline std::string format_value<unsigned long>(const unsigned long& value, const std::string& formatSpec) {
-    return format_integer_value(static_cast<long long>(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const float& value, const FormatSpec& spec) {
+    append_double(sink, static_cast<double>(value), spec);
 }
 
-template<>
-inline std::string format_value<unsigned long long>(const unsigned long long& value, const std::string& formatSpec) {
-    return format_integer_value(static_cast<long long>(value), formatSpec);
+/**
+ * @brief Write a signed integer: sign and magnitude, except for x/X/o/u
+ *
+ * Like printf, the unsigned types print a negative value as the two's
+ * complement of its own width ({0:x} of int -7 is fffffff9). Binary has no
+ * printf counterpart and keeps the sign ({0:#b} of -5 is -0b101).
+ */
+template<typename Sink, typename T>
+void append_signed_integer(Sink& sink, T value, const FormatSpec& spec) {
+    typedef typename std::make_unsigned<T>::type unsigned_type;
+    char type = spec.format_type;
+    if (value >= 0) {
+        append_integer(sink, static_cast<unsigned long long>(value), false, spec);
+    } else if (type == 'x' || type == 'X' || type == 'o' || type == 'u') {
+        append_integer(sink, static_cast<unsigned long long>(static_cast<unsigned_type>(value)), false, spec);
+    } else {
+        append_integer(sink, 0ULL - static_cast<unsigned long long>(value), true, spec);
+    }
 }
 
-template<>
-inline std::string format_value<char>(const char& value, const std::string& formatSpec) {
-    // If format spec looks like integer format, treat as int
-    if (!formatSpec.empty() && (formatSpec.back() == 'd' || formatSpec.back() == 'x' || formatSpec.back() == 'o')) {
-        return format_integer_value(static_cast<long long>(value), formatSpec);
-    }
-    
-    std::string str(1, value);
-    return apply_string_formatting(str, formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const long long& value, const FormatSpec& spec) {
+    append_signed_integer(sink, value, spec);
 }
 
-template<>
-inline std::string format_value<bool>(const bool& value, const std::string& formatSpec) {
-    std::string str = value ? "true" : "false";
-    return apply_string_formatting(str, formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const int& value, const FormatSpec& spec) {
+    append_signed_integer(sink, value, spec);
 }
 
-template<>
-inline std::string format_value<std::string>(const std::string& value, const std::string& formatSpec) {
-    return apply_string_formatting(value, formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const long& value, const FormatSpec& spec) {
+    append_signed_integer(sink, value, spec);
 }
 
-template<>
-inline std::string format_value<const char*>(const char* const& value, const std::string& formatSpec) {
-    return apply_string_formatting(std::string(value), formatSpec);
+template<typename Sink>
+void append_formatted(Sink& sink, const unsigned long long& value, const FormatSpec& spec) {
+    append_integer(sink, value, false, spec);
+}
+
+template<typename Sink>
+void append_formatted(Sink& sink, const unsigned int& value, const FormatSpec& spec) {
+    append_integer(sink, value, false, spec);
+}
+
+template<typename Sink>
+void append_formatted(Sink& sink, const unsigned long& value, const FormatSpec& spec) {
+    append_integer(sink, value, false, spec);
 }
 
 /**
- * @brief Apply format specification to a string value
- * This function attempts to determine the type from the string and apply appropriate formatting
+ * @brief Append text (a variable value) formatted with spec
+ *
+ * Numeric types parse the text as a number first; text that is not a number
+ * is aligned as a string.
  */
-inline std::string apply_format(const std::string& value, const std::string& formatSpec) {
-    if (formatSpec.empty()) {
-        return value;
-    }
-    
-    // Parse the format spec to separate alignment/width from type specifier
-    // Format: [alignment][width][.precision][type]
-    std::string spec = formatSpec;
-    
-    // Extract alignment (-, ^)
-    std::string alignment;
-    size_t pos = 0;
-    if (!spec.empty() && (spec[0] == '-' || spec[0] == '^')) {
-        alignment = spec[0];
-        pos = 1;
-    }
-    
-    // Find the type specifier (last non-digit character)
-    char typeSpec = '\0';
-    std::string numericPart;
-    
-    // Look for type character (f, d, x, etc.)
-    for (size_t i = spec.length(); i > pos; --i) {
-        char c = spec[i-1];
-        if (!std::isdigit(c) && c != '.') {
-            typeSpec = c;
-            numericPart = spec.substr(pos, i-1-pos);
-            break;
-        }
-    }
-    
-    // If no type specifier found, use whole remaining part
-    if (typeSpec == '\0') {
-        numericPart = spec.substr(pos);
-    }
-    
-    // Check if it's a numeric format and handle accordingly
-    if (typeSpec == 'f' || typeSpec == 'F' || typeSpec == 'g' || typeSpec == 'G' || 
-        typeSpec == 'e' || typeSpec == 'E') {
-        // Floating point format
-        try {
-            double numValue = std::stod(value);
-            
-            // Apply alignment if specified (only width, no precision for alignment)
-            if (!alignment.empty()) {
-                // Extract width and precision parts for separate handling
-                std::string widthPart;
-                std::string precisionPart;
-                size_t dotPos = numericPart.find('.');
-                if (dotPos != std::string::npos) {
-                    widthPart = numericPart.substr(0, dotPos);
-                    precisionPart = numericPart.substr(dotPos); // includes the dot
-                } else {
-                    widthPart = numericPart;
-                }
-                
-                // Format number with precision only (no width for printf)
-                std::string numericFormat = precisionPart + typeSpec;
-                std::string formattedNum = format_double_value(numValue, numericFormat);
-                
-                // Apply alignment and width through string formatting
-                return apply_string_formatting(formattedNum, alignment + widthPart);
-            } else {
-                // No alignment specified, use full printf formatting
-                std::string numericFormat = numericPart + typeSpec;
-                return format_double_value(numValue, numericFormat);
-            }
-        } catch (const std::exception&) {
-            // If parsing fails, treat as string
-            return apply_string_formatting(value, formatSpec);
-        }
-    }
-    
-    if (typeSpec == 'd' || typeSpec == 'i' || typeSpec == 'x' || typeSpec == 'X' || 
-        typeSpec == 'o' || typeSpec == 'u' || typeSpec == 'b' || typeSpec == 'B') {
-        // Integer format
+template<typename Sink>
+void append_text_formatted(Sink& sink, const char* data, size_t size, const FormatSpec& spec) {
+    if (is_float_type(spec.format_type) || (is_integer_type(spec.format_type) && spec.format_type != 'c')) {
+        std::string text(data, size);
         try {
-            long long numValue = std::stoll(value);
-            
-            // Apply alignment if specified (only width, no precision for alignment)
-            if (!alignment.empty()) {
-                // Extract width and precision parts for separate handling
-                std::string widthPart;
-                std::string precisionPart;
-                size_t dotPos = numericPart.find('.');
-                if (dotPos != std::string::npos) {
-                    widthPart = numericPart.substr(0, dotPos);
-                    precisionPart = numericPart.substr(dotPos); // includes the dot
-                } else {
-                    widthPart = numericPart;
-                }
-                
-                // Format number with precision only (no width for printf)
-                std::string numericFormat = precisionPart + typeSpec;
-                std::string formattedNum = format_integer_value(numValue, numericFormat);
-                
-                // Apply alignment and width through string formatting
-                return apply_string_formatting(formattedNum, alignment + widthPart);
+            if (is_float_type(spec.format_type)) {
+                append_double(sink, std::stod(text), spec);
             } else {
-                // No alignment specified, use full printf formatting
-                std::string numericFormat = numericPart + typeSpec;
-                return format_integer_value(numValue, numericFormat);
+                append_formatted(sink, std::stoll(text), spec);
             }
+            return;
         } catch (const std::exception&) {
-            // If parsing fails, treat as string
-            return apply_string_formatting(value, formatSpec);
+            // Not a number, format as string
         }
     }
-    
-    // Default to string formatting (width/justification)
-    return apply_string_formatting(value, formatSpec);
+    append_aligned(sink, data, size, spec);
 }
 
-} // namespace detail
+/**
+ * @brief Format a value with a parsed spec
+ */
+template<typename T>
+std::string format_value(const T& value, const FormatSpec& spec) {
+    std::string result;
+    append_formatted(result, value, spec);
+    return result;
+}
 
 /**
- * @brief Public to_string function for user-defined types
- * @ingroup integration
- * 
- * This function will automatically use ustr::to_string() when UFMT_USE_USTR is defined,
- * otherwise it falls back to the internal implementation.
- * 
- * Usage:
- * - Without UFMT_USE_USTR: Uses ostringstream or specialized conversions
- * - With UFMT_USE_USTR: Uses ustr::to_string() for universal type support
+ * @brief Format a value with a spec string
  */
 template<typename T>
-std::string to_string(const T& value) {
-    return detail::to_string_impl(value);
+std::string format_value(const T& value, const std::string& formatSpec) {
+    return format_value(value, parse_format_spec(formatSpec));
 }
 
-// ========== Base Context Interface ==========
+// Formatting function of a type-erased value; spec is null for the default representation
+typedef std::string (*erased_format_fn)(const void* value, const FormatSpec* spec);
+
+template<typename T>
+std::string format_erased(const void* value, const FormatSpec* spec) {
+    const T& typed = *static_cast<const T*>(value);
+    return spec ? format_value(typed, *spec) : to_string_impl(typed);
+}
 
 /**
- * @brief Base class for all formatting contexts - provides core formatting logic
- * @ingroup contexts
+ * @brief Whether a value can be copied now and formatted later from its bytes
  *
- * The format() method supports the following format string features:
- *   - Positional and named placeholders: {0}, {name}
- *   - Alignment: '-' (left), '^' (center), default (right)
- *   - Width: {name:10} (pads to width 10)
- *   - Truncation: {name:.8} (truncate string to 8 chars, ellipsis if >3)
- *   - Center alignment: {name:^10}
+ * Arithmetic, enum and pointer values (printed as addresses) refer to no other
+ * memory. Other trivially copyable types may (a struct holding a const char*,
+ * std::string_view), and character pointers are printed as text, so deferred
+ * records convert those at capture time.
+ */
+template<typename T>
+struct is_self_contained : std::integral_constant<bool,
+    std::is_arithmetic<T>::value || std::is_enum<T>::value ||
+    (std::is_pointer<T>::value &&
+     !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value &&
+     !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, signed char>::value &&
+     !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, unsigned char>::value)> {};
+
+/**
+ * @brief Format double value with printf-style format specification
+ */
+UFMT_DECL std::string format_double_value(double value, const std::string& formatSpec);
+
+/**
+ * @brief Format integer value with printf-style format specification
+ */
+UFMT_DECL std::string format_integer_value(long long value, const std::string& formatSpec);
+
+/**
+ * @brief Applies width, alignment, and truncation to a string value according to formatSpec.
+ *
+ * Format spec syntax: [[fill]alignment][width][.precision]
+ *   - fill: padding character (default space), must be followed by an alignment
+ *   - alignment: '-' or '<' (left), '^' (center), '>' or default (right)
+ *   - width: minimum field width
+ *   - .precision: for strings, truncates to max length (ellipsis if >3)
+ *
+ * Examples:
+ *   {name:10}    // right-aligned, width 10
+ *   {name:-10}   // left-aligned, width 10
+ *   {name:^10}   // center-aligned, width 10
+ *   {name:*^10}  // center-aligned, width 10, padded with '*'
+ *   {msg:.8}     // truncate string to 8 chars
+ *   {s:^12.5}    // center, width 12, truncate to 5 chars
+ *
+ * @param value String value to format
+ * @param formatSpec Format specification string
+ * @return Formatted string
+ */
+UFMT_DECL std::string apply_string_formatting(const std::string& value, const std::string& formatSpec);
+
+/**
+ * @brief Apply a parsed format specification to a string value
+ * Numeric types are applied to the value parsed as a number
+ */
+UFMT_DECL std::string apply_format(const std::string& value, const FormatSpec& spec);
+
+/**
+ * @brief Apply format specification to a string value
+ */
+UFMT_DECL std::string apply_format(const std::string& value, const std::string& formatSpec);
+
+/**
+ * @brief Append the default (no format spec) representation of a value to a sink
+ *
+ * Produces the same text as to_string_impl() without building a temporary
+ * std::string for strings, characters, booleans and arithmetic types.
+ */
+template<typename Sink, typename T>
+void append_default(Sink& sink, const T& value) {
+    std::string text = to_string_impl(value);
+    sink.append(text.data(), text.length());
+}
+
+template<typename Sink>
+void append_default(Sink& sink, const std::string& value) {
+    sink.append(value.data(), value.length());
+}
+
+template<typename Sink>
+void append_default(Sink& sink, const char* const& value) {
+    sink.append(value, std::strlen(value));
+}
+
+template<typename Sink>
+void append_default(Sink& sink, char* const& value) {
+    sink.append(value, std::strlen(value));
+}
+
+#ifndef UFMT_USE_USTR
+template<typename Sink>
+void append_default(Sink& sink, const bool& value) {
+    if (value) {
+        sink.append("true", 4);
+    } else {
+        sink.append("false", 5);
+    }
+}
+
+template<typename Sink>
+void append_default(Sink& sink, const char& value) {
+    sink.append(&value, 1);
+}
+
+template<typename Sink>
+void append_unsigned(Sink& sink, unsigned long long value, bool negative) {
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* p = end;
+    do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    if (negative) {
+        *--p = '-';
+    }
+    sink.append(p, static_cast<size_t>(end - p));
+}
+
+template<typename Sink>
+void append_signed(Sink& sink, long long value) {
+    unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    append_unsigned(sink, magnitude, value < 0);
+}
+
+template<typename Sink>
+void append_default(Sink& sink, const int& value) { append_signed(sink, value); }
+
+template<typename Sink>
+void append_default(Sink& sink, const long& value) { append_signed(sink, value); }
+
+template<typename Sink>
+void append_default(Sink& sink, const long long& value) { append_signed(sink, value); }
+
+template<typename Sink>
+void append_default(Sink& sink, const unsigned int& value) { append_unsigned(sink, value, false); }
+
+template<typename Sink>
+void append_default(Sink& sink, const unsigned long& value) { append_unsigned(sink, value, false); }
+
+template<typename Sink>
+void append_default(Sink& sink, const unsigned long long& value) { append_unsigned(sink, value, false); }
+
+template<typename Sink>
+void append_default(Sink& sink, const double& value) {
+    char buffer[512];  // "%f" of DBL_MAX needs 316 characters
+    int length = snprintf(buffer, sizeof(buffer), "%f", value);
+    if (length > 0) {
+        sink.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+template<typename Sink>
+void append_default(Sink& sink, const float& value) {
+    append_default(sink, static_cast<double>(value));
+}
+#endif
+
+} // namespace detail
+
+/**
+ * @brief Public to_string function for user-defined types
+ * @ingroup integration
+ * 
+ * This function will automatically use ustr::to_string() when UFMT_USE_USTR is defined,
+ * otherwise it falls back to the internal implementation.
+ * 
+ * Usage:
+ * - Without UFMT_USE_USTR: Uses ostringstream or specialized conversions
+ * - With UFMT_USE_USTR: Uses ustr::to_string() for universal type support
+ */
+template<typename T>
+std::string to_string(const T& value) {
+    return detail::to_string_impl(value);
+}
+
+// ========== Output Escaping ==========
+
+/**
+ * @brief Escaping applied to substituted values
+ * @ingroup formatting
+ *
+ * Selected per placeholder with a modifier ({name!json}, {0!html:-10},
+ * {field!csv}, {raw!raw}) or for a whole context with set_escape_mode().
+ * Literal template text is never escaped.
+ */
+enum class escape_mode {
+    none,  ///< Values are inserted as-is (modifier !raw)
+    json,  ///< JSON string content: '"', '\\' and control characters are escaped
+    html,  ///< HTML text and attributes: & < > " ' become entities
+    csv    ///< CSV field: quoted, with '"' doubled, if it contains , " CR or LF
+};
+
+namespace detail {
+
+// Index of the lowest set bit (mask must not be zero)
+inline unsigned lowest_bit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Character classes of the escape modes, scalar and vectorized
+struct json_special {
+    static bool match(unsigned char c) { return c == '"' || c == '\\' || c < 0x20; }
+#ifdef UFMT_SIMD_SSE2
+    static __m128i match(__m128i block) {
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(block, _mm_set1_epi8(0x1f)), block);
+        return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                                         _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))), control);
+    }
+#endif
+#ifdef UFMT_SIMD_NEON
+    static uint8x16_t match(uint8x16_t block) {
+        return vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8('"')), vceqq_u8(block, vdupq_n_u8('\\'))),
+                        vcltq_u8(block, vdupq_n_u8(0x20)));
+    }
+#endif
+};
+
+struct html_special {
+    static bool match(unsigned char c) { return c == '&' || c == '<' || c == '>' || c == '"' || c == '\''; }
+#ifdef UFMT_SIMD_SSE2
+    static __m128i match(__m128i block) {
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('&')), _mm_cmpeq_epi8(block, _mm_set1_epi8('<')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('>')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('"')));
+        return _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('\'')));
+    }
+#endif
+#ifdef UFMT_SIMD_NEON
+    static uint8x16_t match(uint8x16_t block) {
+        uint8x16_t hits = vorrq_u8(vceqq_u8(block, vdupq_n_u8('&')), vceqq_u8(block, vdupq_n_u8('<')));
+        hits = vorrq_u8(hits, vceqq_u8(block, vdupq_n_u8('>')));
+        hits = vorrq_u8(hits, vceqq_u8(block, vdupq_n_u8('"')));
+        return vorrq_u8(hits, vceqq_u8(block, vdupq_n_u8('\'')));
+    }
+#endif
+};
+
+struct csv_special {
+    static bool match(unsigned char c) { return c == ',' || c == '"' || c == '\n' || c == '\r'; }
+#ifdef UFMT_SIMD_SSE2
+    static __m128i match(__m128i block) {
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(',')), _mm_cmpeq_epi8(block, _mm_set1_epi8('"')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+        return _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('\r')));
+    }
+#endif
+#ifdef UFMT_SIMD_NEON
+    static uint8x16_t match(uint8x16_t block) {
+        uint8x16_t hits = vorrq_u8(vceqq_u8(block, vdupq_n_u8(',')), vceqq_u8(block, vdupq_n_u8('"')));
+        hits = vorrq_u8(hits, vceqq_u8(block, vdupq_n_u8('\n')));
+        return vorrq_u8(hits, vceqq_u8(block, vdupq_n_u8('\r')));
+    }
+#endif
+};
+
+/**
+ * @brief First character of [begin, end) in the class Special, or end
+ *
+ * Checks 16 bytes per step with SSE2 or NEON where available.
+ */
+template<typename Special>
+const char* find_special(const char* begin, const char* end) {
+#if defined(UFMT_SIMD_SSE2)
+    for (; end - begin >= 16; begin += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(Special::match(block)));
+        if (mask != 0) {
+            return begin + lowest_bit(mask);
+        }
+    }
+#elif defined(UFMT_SIMD_NEON)
+    for (; end - begin >= 16; begin += 16) {
+        uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(begin));
+        if (vmaxvq_u8(Special::match(block)) != 0) {
+            break;  // Locate it in the scalar loop
+        }
+    }
+#endif
+    for (; begin < end; ++begin) {
+        if (Special::match(static_cast<unsigned char>(*begin))) {
+            break;
+        }
+    }
+    return begin;
+}
+
+template<typename Sink>
+void append_json_escaped(Sink& sink, const char* data, const char* end) {
+    static const char hex[] = "0123456789abcdef";
+    for (;;) {
+        const char* special = find_special<json_special>(data, end);
+        sink.append(data, static_cast<size_t>(special - data));
+        if (special == end) {
+            return;
+        }
+        unsigned char c = static_cast<unsigned char>(*special);
+        switch (c) {
+        case '"': sink.append("\\\"", 2); break;
+        case '\\': sink.append("\\\\", 2); break;
+        case '\n': sink.append("\\n", 2); break;
+        case '\r': sink.append("\\r", 2); break;
+        case '\t': sink.append("\\t", 2); break;
+        case '\b': sink.append("\\b", 2); break;
+        case '\f': sink.append("\\f", 2); break;
+        default: {
+            char unicode[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            sink.append(unicode, sizeof(unicode));
+        }
+        }
+        data = special + 1;
+    }
+}
+
+template<typename Sink>
+void append_html_escaped(Sink& sink, const char* data, const char* end) {
+    for (;;) {
+        const char* special = find_special<html_special>(data, end);
+        sink.append(data, static_cast<size_t>(special - data));
+        if (special == end) {
+            return;
+        }
+        switch (*special) {
+        case '&': sink.append("&amp;", 5); break;
+        case '<': sink.append("&lt;", 4); break;
+        case '>': sink.append("&gt;", 4); break;
+        case '"': sink.append("&quot;", 6); break;
+        default: sink.append("&#39;", 5); break;
+        }
+        data = special + 1;
+    }
+}
+
+template<typename Sink>
+void append_csv_escaped(Sink& sink, const char* data, const char* end) {
+    if (find_special<csv_special>(data, end) == end) {
+        sink.append(data, static_cast<size_t>(end - data));
+        return;
+    }
+    sink.append("\"", 1);
+    const char* quote;
+    while ((quote = static_cast<const char*>(std::memchr(data, '"', static_cast<size_t>(end - data)))) != nullptr) {
+        sink.append(data, static_cast<size_t>(quote + 1 - data));
+        sink.append("\"", 1);
+        data = quote + 1;
+    }
+    sink.append(data, static_cast<size_t>(end - data));
+    sink.append("\"", 1);
+}
+
+/**
+ * @brief Append a value to a sink, escaped for the given mode
+ */
+template<typename Sink>
+void append_escaped(Sink& sink, const char* data, size_t size, escape_mode mode) {
+    switch (mode) {
+    case escape_mode::json: append_json_escaped(sink, data, data + size); break;
+    case escape_mode::html: append_html_escaped(sink, data, data + size); break;
+    case escape_mode::csv: append_csv_escaped(sink, data, data + size); break;
+    default: sink.append(data, size); break;
+    }
+}
+
+/**
+ * @brief Sink adapter escaping everything appended to it
+ *
+ * JSON and HTML escaping is streamed. An adapter holds a single value in CSV
+ * mode: the pieces are collected and quoted as one field when it is destroyed.
+ */
+template<typename Sink>
+class escaping_sink {
+public:
+    escaping_sink(Sink& sink, escape_mode mode) : sink_(sink), mode_(mode) {}
+
+    ~escaping_sink() {
+        if (mode_ == escape_mode::csv) {
+            append_csv_escaped(sink_, field_.data(), field_.data() + field_.size());
+        }
+    }
+
+    escaping_sink(const escaping_sink&) = delete;
+    escaping_sink& operator=(const escaping_sink&) = delete;
+
+    void append(const char* data, size_t size) {
+        if (mode_ == escape_mode::csv) {
+            field_.append(data, size);
+        } else {
+            append_escaped(sink_, data, size, mode_);
+        }
+    }
+
+private:
+    Sink& sink_;
+    escape_mode mode_;
+    std::string field_;  // CSV value collected so far
+};
+
+} // namespace detail
+
+// ========== Typed Variables ==========
+
+namespace detail {
+
+/**
+ * @brief JSON type of a context variable, recorded by context_base::set_var()
+ */
+enum class var_kind { string, integer, number, boolean };
+
+/**
+ * @brief Stored context variable: text form plus the type it was set from
+ */
+struct var_value {
+    std::string text;
+    var_kind kind;
+
+    var_value() : kind(var_kind::string) {}
+    var_value(const std::string& value, var_kind type) : text(value), kind(type) {}
+};
+
+template<typename T>
+var_kind kind_of() {
+    return std::is_same<T, bool>::value ? var_kind::boolean
+         : std::is_same<T, char>::value ? var_kind::string
+         : std::is_integral<T>::value ? var_kind::integer
+         : std::is_floating_point<T>::value ? var_kind::number
+         : var_kind::string;
+}
+
+/**
+ * @brief Check that text is a valid JSON number (rejects "inf", "nan", "1.", ...)
+ */
+inline bool is_json_number(const std::string& text) {
+    const char* p = text.c_str();
+    if (*p == '-') {
+        ++p;
+    }
+    if (*p == '0') {
+        ++p;
+    } else if (*p >= '1' && *p <= '9') {
+        while (*p >= '0' && *p <= '9') ++p;
+    } else {
+        return false;
+    }
+    if (*p == '.') {
+        ++p;
+        if (!(*p >= '0' && *p <= '9')) return false;
+        while (*p >= '0' && *p <= '9') ++p;
+    }
+    if (*p == 'e' || *p == 'E') {
+        ++p;
+        if (*p == '+' || *p == '-') ++p;
+        if (!(*p >= '0' && *p <= '9')) return false;
+        while (*p >= '0' && *p <= '9') ++p;
+    }
+    return static_cast<size_t>(p - text.c_str()) == text.size();
+}
+
+/**
+ * @brief Append a variable as a JSON value: numbers and booleans unquoted, the rest as escaped strings
+ */
+template<typename Sink>
+void append_json_value(Sink& sink, const var_value& value) {
+    bool raw = (value.kind == var_kind::boolean && (value.text == "true" || value.text == "false")) ||
+               ((value.kind == var_kind::integer || value.kind == var_kind::number) && is_json_number(value.text));
+    if (raw) {
+        sink.append(value.text.data(), value.text.size());
+        return;
+    }
+    sink.append("\"", 1);
+    append_json_escaped(sink, value.text.data(), value.text.data() + value.text.size());
+    sink.append("\"", 1);
+}
+
+} // namespace detail
+
+// ========== Template Scanning ==========
+
+namespace detail {
+
+/**
+ * @brief Function returning the first '{' or '}' in [begin, end), or end
+ */
+typedef const char* (*find_brace_fn)(const char* begin, const char* end);
+
+inline const char* find_brace_scalar(const char* begin, const char* end) {
+    for (; begin < end; ++begin) {
+        if (*begin == '{' || *begin == '}') {
+            break;
+        }
+    }
+    return begin;
+}
+
+#ifdef UFMT_SIMD_SSE2
+inline const char* find_brace_sse2(const char* begin, const char* end) {
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    for (; end - begin >= 16; begin += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, open), _mm_cmpeq_epi8(block, close));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) {
+            return begin + lowest_bit(mask);
+        }
+    }
+    return find_brace_scalar(begin, end);
+}
+#endif
+
+#ifdef UFMT_SIMD_AVX2
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+inline const char* find_brace_avx2(const char* begin, const char* end) {
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    for (; end - begin >= 32; begin += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, open), _mm256_cmpeq_epi8(block, close));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return begin + lowest_bit(mask);
+        }
+    }
+    return find_brace_sse2(begin, end);
+}
+
+UFMT_DECL bool cpu_has_avx2();
+#endif
+
+#ifdef UFMT_SIMD_NEON
+inline const char* find_brace_neon(const char* begin, const char* end) {
+    const uint8x16_t open = vdupq_n_u8('{');
+    const uint8x16_t close = vdupq_n_u8('}');
+    for (; end - begin >= 16; begin += 16) {
+        uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(begin));
+        uint8x16_t hits = vorrq_u8(vceqq_u8(block, open), vceqq_u8(block, close));
+        if (vmaxvq_u8(hits) != 0) {
+            return find_brace_scalar(begin, begin + 16);
+        }
+    }
+    return find_brace_scalar(begin, end);
+}
+#endif
+
+UFMT_DECL find_brace_fn select_find_brace();
+
+/**
+ * @brief Find the first '{' or '}' in [begin, end), or end
+ *
+ * Uses AVX2 when the CPU supports it (checked once), SSE2 or NEON otherwise,
+ * and a scalar loop on other platforms or with UFMT_NO_SIMD.
+ */
+inline const char* find_brace(const char* begin, const char* end) {
+    static const find_brace_fn fn = select_find_brace();
+    return fn(begin, end);
+}
+
+#ifdef UFMT_ENABLE_PROFILING
+/**
+ * @brief Profile entry of a compiled template, see record_profile()
+ *
+ * Holds the profile generation and entry index, found by the template text on
+ * the first profiled call; profile_reset() starts a new generation, which sends
+ * the next call back to the text lookup. Copies look up their own entry.
+ */
+struct profile_slot {
+    mutable std::atomic<std::uint64_t> key;  // generation << 32 | entry index, 0 until looked up
+
+    profile_slot() : key(0) {}
+    profile_slot(const profile_slot& /* other */) : key(0) {}
+    profile_slot& operator=(const profile_slot& /* other */) { return *this; }
+};
+#endif
+
+/**
+ * @brief Placeholder parsed in place, pointing into the template text
+ */
+struct placeholder_ref {
+    bool positional;
+    size_t index;        // Positional argument index
+    const char* name;    // Variable name for named placeholders
+    size_t name_length;
+    const char* spec;    // Format specification (text after ':')
+    size_t spec_length;
+    bool has_spec;
+    escape_mode escape;  // Escaping modifier after '!'
+    bool has_escape;
+};
+
+// Escaping modifier name, false if unknown
+UFMT_DECL bool parse_escape_mode(const char* name, size_t length, escape_mode& mode);
+
+/**
+ * @brief Parse the text between '{' and '}' (exclusive), see compiled_template
+ *
+ * Syntax: name-or-index ['!' modifier] [':' spec]
+ * @return false if the text is not a placeholder and must be kept literally
+ */
+UFMT_DECL bool parse_placeholder(const char* begin, const char* end, placeholder_ref& ph);
+
+/**
+ * @brief Single pass over a template, reporting literal runs and placeholders
+ *
+ * Calls on_literal(const char* data, size_t size) for literal text and
+ * on_placeholder(const placeholder_ref&, const char* open, size_t length) for
+ * every placeholder ("{...}" text passed for verbatim fallback). "{{" and "}}"
+ * are escapes for a single brace; the literal text around them is reported in
+ * place, without copying. Other braces that do not form a placeholder are
+ * literal text; of nested '{' the innermost one opens the placeholder.
+ */
+template<typename LiteralFn, typename PlaceholderFn>
+void scan_template(const char* data, size_t size, LiteralFn&& on_literal, PlaceholderFn&& on_placeholder) {
+    const char* end = data + size;
+    const char* literal = data;
+    const char* open = nullptr;
+    const char* pos = data;
+    while ((pos = find_brace(pos, end)) != end) {
+        if (*pos == '{') {
+            if (pos + 1 < end && pos[1] == '{') {
+                // "{{": emit the text up to and including the first brace
+                on_literal(literal, static_cast<size_t>(pos + 1 - literal));
+                literal = pos + 2;
+                open = nullptr;
+                pos += 2;
+                continue;
+            }
+            open = pos;  // Innermost '{' wins
+        } else if (open) {
+            placeholder_ref ph;
+            if (parse_placeholder(open + 1, pos, ph)) {
+                if (open > literal) {
+                    on_literal(literal, static_cast<size_t>(open - literal));
+                }
+                on_placeholder(ph, open, static_cast<size_t>(pos - open + 1));
+                literal = pos + 1;
+            }
+            open = nullptr;
+        } else if (pos + 1 < end && pos[1] == '}') {
+            // "}}" outside a placeholder
+            on_literal(literal, static_cast<size_t>(pos + 1 - literal));
+            literal = pos + 2;
+            pos += 2;
+            continue;
+        }
+        ++pos;
+    }
+    if (end > literal) {
+        on_literal(literal, static_cast<size_t>(end - literal));
+    }
+}
+
+} // namespace detail
+
+// ========== Compiled Templates ==========
+
+/**
+ * @brief Template string pre-split into literal runs and placeholders
+ * @ingroup core
+ *
+ * A compiled template is immutable once constructed and can be shared freely
+ * between threads. Placeholders follow the same rules as format():
+ *   - {N} and {N:spec} refer to positional arguments (N without leading zeros)
+ *   - {name} and {name:spec} refer to named variables
+ *   - {N!json}, {name!html:spec}, ... select an escape_mode for the value
+ *   - {{ and }} produce a literal '{' and '}'
+ *   - a placeholder never contains '{', anything else is literal text
+ *
+ * Placeholders that cannot be resolved at format time (missing argument,
+ * unknown variable) are emitted verbatim.
+ */
+class compiled_template {
+public:
+    /**
+     * @brief Kind of a template segment
+     */
+    enum class segment_kind {
+        literal,     ///< Literal text
+        positional,  ///< Positional argument placeholder
+        named        ///< Named variable placeholder
+    };
+
+    /**
+     * @brief One literal run or placeholder of a template
+     */
+    struct segment {
+        segment_kind kind;
+        size_t offset;      ///< Start of the segment text in source()
+        size_t length;      ///< Length of the segment text (whole "{...}" for placeholders)
+        size_t index;       ///< Positional argument index
+        std::string name;   ///< Variable name for named placeholders
+        std::string spec;   ///< Format specification (text after ':')
+        bool has_spec;      ///< True if the placeholder contains ':'
+        escape_mode escape; ///< Escaping modifier ("!json" etc.)
+        bool has_escape;    ///< True if the placeholder has a modifier, otherwise the context mode applies
+        FormatSpec format;  ///< Parsed format specification
+    };
+
+    /**
+     * @brief Parse a template string
+     * @param source Template string with placeholders
+     */
+    explicit compiled_template(const std::string& source)
+        : source_(source), arg_count_(0), named_count_(0) {
+        parse();
+    }
+
+    /**
+     * @brief Original template string
+     */
+    const std::string& source() const { return source_; }
+
+    /**
+     * @brief Literal runs and placeholders in template order
+     */
+    const std::vector<segment>& segments() const { return segments_; }
+
+    /**
+     * @brief Number of positional arguments referenced (highest index + 1)
+     */
+    size_t arg_count() const { return arg_count_; }
+
+    /**
+     * @brief Number of named placeholders
+     */
+    size_t named_count() const { return named_count_; }
+
+#ifdef UFMT_ENABLE_PROFILING
+    /**
+     * @brief Profile entry of this template object, so profiled calls skip the text lookup
+     */
+    const detail::profile_slot& profile_slot() const { return profile_slot_; }
+#endif
+
+private:
+    std::string source_;
+    std::vector<segment> segments_;
+    size_t arg_count_;
+    size_t named_count_;
+#ifdef UFMT_ENABLE_PROFILING
+    detail::profile_slot profile_slot_;
+#endif
+
+    void parse();
+};
+
+/**
+ * @brief Compile a template string for repeated use
+ * @ingroup core
+ * @param template_str Template string with placeholders
+ * @return Shared pointer to the immutable compiled template
+ */
+inline std::shared_ptr<const compiled_template> compile(const std::string& template_str) {
+    return std::make_shared<const compiled_template>(template_str);
+}
+
+#ifndef UFMT_TEMPLATE_CACHE_SIZE
+// Templates of format() calls each thread keeps compiled; further templates are compiled per call
+#define UFMT_TEMPLATE_CACHE_SIZE 1024
+#endif
+
+namespace detail {
+
+/**
+ * @brief Compiled form of a format() template, from the calling thread's cache
+ * @param template_str Template string, compiled on its first use by the thread
+ * @param uncached Receives the compiled template when the cache is full
+ *
+ * Cached templates are never evicted, so the reference stays valid while a
+ * custom formatter formats other templates.
+ */
+UFMT_DECL const compiled_template& cached_template(const std::string& template_str,
+                                                   std::unique_ptr<compiled_template>& uncached);
+
+} // namespace detail
+
+// ========== Template Profiling ==========
+
+#ifndef UFMT_PROFILE_MAX_TEMPLATES
+// Distinct templates tracked by the process; further templates share one entry
+#define UFMT_PROFILE_MAX_TEMPLATES 4096
+#endif
+
+/**
+ * @brief Accumulated cost of one template, see ufmt::profile_report()
+ * @ingroup core
+ */
+struct template_profile {
+    std::string template_str;                 ///< Template text (empty for the overflow entry)
+    unsigned long long calls = 0;             ///< Formatting calls (a format_batch() call counts once)
+    unsigned long long compiled_calls = 0;    ///< Calls made with a compiled_template (records, batches)
+    unsigned long long total_ns = 0;          ///< Total time spent in those calls
+    unsigned long long max_ns = 0;            ///< Slowest single call
+    unsigned long long bytes = 0;             ///< Output bytes (before escaping by format_json())
+    bool overflow = false;                    ///< Templates seen after UFMT_PROFILE_MAX_TEMPLATES others
+
+    double mean_ns() const { return calls ? static_cast<double>(total_ns) / static_cast<double>(calls) : 0.0; }
+};
+
+namespace detail {
+
+#ifdef UFMT_ENABLE_PROFILING
+
+// Add one call to the table of the calling thread, under the entry the slot names;
+// the slot is filled from the template text when it is unset or from before the last reset
+UFMT_DECL void record_profile(const profile_slot& slot, const std::string& template_str, bool compiled,
+                              unsigned long long ns, size_t bytes);
+
+/**
+ * @brief Times one formatting call and records it under its compiled template
+ *
+ * format() calls start timing before their template is looked up in the
+ * thread's template cache and name it with attach(). Calls that throw are
+ * not recorded.
+ */
+class profile_scope {
+public:
+    explicit profile_scope(const compiled_template& tmpl)
+        : template_(&tmpl), compiled_(true), start_(std::chrono::steady_clock::now()) {}
+
+    profile_scope() : template_(nullptr), compiled_(false), start_(std::chrono::steady_clock::now()) {}
+
+    void attach(const compiled_template& tmpl) { template_ = &tmpl; }
+
+    void finish(size_t bytes) const {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start_;
+        record_profile(template_->profile_slot(), template_->source(), compiled_,
+                       static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                       bytes);
+    }
+
+private:
+    const compiled_template* template_;
+    bool compiled_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#else
+
+// Profiling disabled: timing compiles to nothing
+class profile_scope {
+public:
+    explicit profile_scope(const compiled_template& /* tmpl */) {}
+    profile_scope() {}
+    void attach(const compiled_template& /* tmpl */) {}
+    void finish(size_t /* bytes */) const {}
+};
+
+#endif
+
+/**
+ * @brief Sink wrapper counting the bytes appended, for profiling generic sinks
+ */
+template<typename Sink>
+class counting_sink {
+public:
+    explicit counting_sink(Sink& sink) : sink_(sink), count_(0) {}
+
+    void append(const char* data, size_t size) {
+        count_ += size;
+        sink_.append(data, size);
+    }
+
+    Sink& inner() { return sink_; }
+    const Sink& inner() const { return sink_; }
+    size_t count() const { return count_; }
+
+private:
+    Sink& sink_;
+    size_t count_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Whether the library was built with UFMT_ENABLE_PROFILING
+ * @ingroup core
+ */
+inline bool profiling_enabled() {
+#ifdef UFMT_ENABLE_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Templates with the highest total formatting time, summed over all threads
+ * @ingroup core
+ * @param n Maximum number of entries (0 = all)
+ * @return Most total time first; empty unless UFMT_ENABLE_PROFILING is defined
+ *
+ * Calls are attributed by template text, so format() calls and compiled
+ * templates with the same text share an entry; compiled_calls tells them
+ * apart.
+ */
+UFMT_DECL std::vector<template_profile> profile_report(size_t n = 0);
+
+/**
+ * @brief Discard the profiles collected so far
+ * @ingroup core
+ *
+ * Stored template texts are released as well, so templates that were
+ * summed in the overflow entry get entries of their own again.
+ */
+UFMT_DECL void profile_reset();
+
+// ========== Deferred Format Records ==========
+
+namespace detail {
+
+/**
+ * @brief Byte buffer with inline storage, spilling to the heap when full
+ */
+class record_buffer {
+public:
+    static const size_t inline_capacity = 192;
+
+    record_buffer() : size_(0), capacity_(inline_capacity) {}
+
+    record_buffer(record_buffer&& other) : size_(0), capacity_(inline_capacity) {
+        take(other);
+    }
+
+    record_buffer& operator=(record_buffer&& other) {
+        if (this != &other) {
+            heap_.reset();
+            size_ = 0;
+            capacity_ = inline_capacity;
+            take(other);
+        }
+        return *this;
+    }
+
+    record_buffer(const record_buffer&) = delete;
+    record_buffer& operator=(const record_buffer&) = delete;
+
+    const char* data() const { return heap_ ? heap_.get() : inline_; }
+    char* data() { return heap_ ? heap_.get() : inline_; }
+    size_t size() const { return size_; }
+
+    void append(const void* bytes, size_t count) {
+        reserve(size_ + count);
+        std::memcpy(data() + size_, bytes, count);
+        size_ += count;
+    }
+
+    void resize(size_t count) {
+        reserve(count);
+        size_ = count;
+    }
+
+    void clear() { size_ = 0; }
+
+private:
+    char inline_[inline_capacity];
+    std::unique_ptr<char[]> heap_;
+    size_t size_;
+    size_t capacity_;
+
+    void reserve(size_t wanted) {
+        if (wanted <= capacity_) {
+            return;
+        }
+        size_t new_capacity = capacity_ * 2;
+        while (new_capacity < wanted) {
+            new_capacity *= 2;
+        }
+        std::unique_ptr<char[]> new_heap(new char[new_capacity]);
+        std::memcpy(new_heap.get(), data(), size_);
+        heap_ = std::move(new_heap);
+        capacity_ = new_capacity;
+    }
+
+    void take(record_buffer& other) {
+        if (other.heap_) {
+            heap_ = std::move(other.heap_);
+            capacity_ = other.capacity_;
+        } else {
+            std::memcpy(inline_, other.inline_, other.size_);
+        }
+        size_ = other.size_;
+        other.size_ = 0;
+        other.capacity_ = inline_capacity;
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Captured arguments of a format call, to be formatted later
+ * @ingroup core
+ *
+ * A record holds a pointer to a compiled template and a compact binary
+ * serialization of the arguments. Arithmetic, enum and pointer values are
+ * stored by value, strings and all other types are copied as text into an
+ * inline buffer (spilling to the heap only for large payloads). Named variables and
+ * custom formatters are resolved at capture time, so the record is
+ * self-contained and can be formatted on any thread via format_to().
+ *
+ * Records are created with ufmt::capture() or context_base::capture().
+ * When capturing with a compiled_template reference the template must
+ * outlive the record; the other overloads keep the template alive.
+ *
+ * @code
+ * static const auto tmpl = ufmt::compile("Order {0} filled at {1:.2f}");
+ * ufmt::format_record rec = ufmt::capture(*tmpl, order_id, price);  // hot thread
+ * std::string line;
+ * rec.format_to(line);                                              // logging thread
+ * @endcode
+ */
+class format_record {
+public:
+    format_record() : template_(nullptr), arg_count_(0), vars_size_(0), escape_(escape_mode::none) {}
+
+    format_record(format_record&& other)
+        : template_(other.template_), owner_(std::move(other.owner_)), buffer_(std::move(other.buffer_)),
+          arg_count_(other.arg_count_), vars_size_(other.vars_size_), escape_(other.escape_) {
+        other.reset();
+    }
+
+    format_record& operator=(format_record&& other) {
+        if (this != &other) {
+            template_ = other.template_;
+            owner_ = std::move(other.owner_);
+            buffer_ = std::move(other.buffer_);
+            arg_count_ = other.arg_count_;
+            vars_size_ = other.vars_size_;
+            escape_ = other.escape_;
+            other.reset();
+        }
+        return *this;
+    }
+
+    format_record(const format_record&) = delete;
+    format_record& operator=(const format_record&) = delete;
+
+    /**
+     * @brief Check if the record holds a captured call
+     */
+    bool empty() const { return template_ == nullptr; }
+
+    /**
+     * @brief Template the record was captured with (nullptr if empty)
+     */
+    const compiled_template* get_template() const { return template_; }
+
+    /**
+     * @brief Size in bytes of the serialized arguments and variables
+     */
+    size_t payload_size() const { return buffer_.size(); }
+
+    /**
+     * @brief Format the record, appending output to a sink
+     * @param sink Any object providing append(const char*, size_t), e.g. std::string
+     */
+    template<typename Sink>
+    void format_to(Sink& sink) const {
+        if (!template_) {
+            return;
+        }
+#ifdef UFMT_ENABLE_PROFILING
+        detail::profile_scope profile(*template_);
+        detail::counting_sink<Sink> counted(sink);
+        write_segments(counted);
+        profile.finish(counted.count());
+#else
+        write_segments(sink);
+#endif
+    }
+
+    /**
+     * @brief Format the record into a new string
+     */
+    std::string str() const {
+        std::string result;
+        format_to(result);
+        return result;
+    }
+
+private:
+    friend class format_context_base;
+
+    template<typename Sink>
+    void write_segments(Sink& sink) const {
+        const std::string& source = template_->source();
+        const char* data = buffer_.data();
+        size_t var_cursor = vars_offset();
+        for (const auto& seg : template_->segments()) {
+            switch (seg.kind) {
+            case compiled_template::segment_kind::literal:
+                sink.append(source.data() + seg.offset, seg.length);
+                break;
+            case compiled_template::segment_kind::positional:
+                if (seg.index < arg_count_) {
+                    escape_mode escape = seg.has_escape ? seg.escape : escape_;
+                    if (escape == escape_mode::none) {
+                        write_arg(sink, arg_offset(seg.index), seg);
+                    } else {
+                        detail::escaping_sink<Sink> escaped(sink, escape);
+                        write_arg(escaped, arg_offset(seg.index), seg);
+                    }
+                } else {
+                    sink.append(source.data() + seg.offset, seg.length);
+                }
+                break;
+            case compiled_template::segment_kind::named:
+                if (var_cursor < buffer_.size()) {
+                    bool found = data[var_cursor] != 0;
+                    std::uint32_t length = read<std::uint32_t>(var_cursor + 1);
+                    const char* value = data + var_cursor + 1 + sizeof(std::uint32_t);
+                    var_cursor += 1 + sizeof(std::uint32_t) + length;
+                    if (found) {
+                        escape_mode escape = seg.has_escape ? seg.escape : escape_;
+                        if (escape == escape_mode::none) {
+                            write_var(sink, value, length, seg);
+                        } else {
+                            detail::escaping_sink<Sink> escaped(sink, escape);
+                            write_var(escaped, value, length, seg);
+                        }
+                        break;
+                    }
+                }
+                sink.append(source.data() + seg.offset, seg.length);
+                break;
+            }
+        }
+    }
+
+    enum arg_tag : unsigned char {
+        tag_int32,     // int (and 32-bit long), keeps its width for x/o/u of negative values
+        tag_int64,
+        tag_uint64,
+        tag_double,
+        tag_bool,
+        tag_char,
+        tag_string,
+        tag_verbatim,  // Output of a custom formatter, ignores format spec
+        tag_trivial    // Arithmetic, enum or pointer value with its formatting function
+    };
+
+    typedef detail::erased_format_fn trivial_format_fn;
+
+    // Holds a tag_trivial value while it is formatted, large enough for any self-contained type
+    union trivial_storage {
+        long double real;
+        unsigned long long integer;
+        const void* pointer;
+    };
+
+    const compiled_template* template_;
+    std::shared_ptr<const compiled_template> owner_;
+    detail::record_buffer buffer_;  // [u32 arg offsets][args][named values]
+    size_t arg_count_;
+    size_t vars_size_;
+    escape_mode escape_;  // Escape mode of the capturing context
+
+    void start(const compiled_template* tmpl, size_t arg_count, escape_mode escape) {
+        template_ = tmpl;
+        arg_count_ = arg_count;
+        vars_size_ = 0;
+        escape_ = escape;
+        buffer_.resize(arg_count * sizeof(std::uint32_t));
+    }
+
+    void reset() {
+        template_ = nullptr;
+        owner_.reset();
+        buffer_.clear();
+        arg_count_ = 0;
+        vars_size_ = 0;
+        escape_ = escape_mode::none;
+    }
+
+    size_t vars_offset() const {
+        return buffer_.size() - vars_size_;
+    }
+
+    template<typename T>
+    T read(size_t offset) const {
+        T value;
+        std::memcpy(&value, buffer_.data() + offset, sizeof(T));
+        return value;
+    }
+
+    size_t arg_offset(size_t index) const {
+        return read<std::uint32_t>(index * sizeof(std::uint32_t));
+    }
+
+    // ----- Encoding -----
+
+    void begin_arg(size_t index, arg_tag tag) {
+        std::uint32_t offset = static_cast<std::uint32_t>(buffer_.size());
+        std::memcpy(buffer_.data() + index * sizeof(std::uint32_t), &offset, sizeof(offset));
+        unsigned char tag_byte = tag;
+        buffer_.append(&tag_byte, 1);
+    }
+
+    template<typename T>
+    void append_value(const T& value) {
+        buffer_.append(&value, sizeof(T));
+    }
+
+    void append_string(const char* value, size_t length) {
+        std::uint32_t length32 = static_cast<std::uint32_t>(length);
+        append_value(length32);
+        buffer_.append(value, length);
+    }
+
+    void add_int(size_t index, int value) { begin_arg(index, tag_int32); append_value(value); }
+    void add_int(size_t index, long long value) { begin_arg(index, tag_int64); append_value(value); }
+    void add_uint(size_t index, unsigned long long value) { begin_arg(index, tag_uint64); append_value(value); }
+
+    void add_arg(size_t index, const int& value) { add_int(index, value); }
+    void add_arg(size_t index, const long& value) {
+        if (sizeof(long) == sizeof(int)) {
+            add_int(index, static_cast<int>(value));
+        } else {
+            add_int(index, static_cast<long long>(value));
+        }
+    }
+    void add_arg(size_t index, const long long& value) { add_int(index, value); }
+    void add_arg(size_t index, const unsigned int& value) { add_uint(index, value); }
+    void add_arg(size_t index, const unsigned long& value) { add_uint(index, value); }
+    void add_arg(size_t index, const unsigned long long& value) { add_uint(index, value); }
+    void add_arg(size_t index, const float& value) { begin_arg(index, tag_double); append_value(static_cast<double>(value)); }
+    void add_arg(size_t index, const double& value) { begin_arg(index, tag_double); append_value(value); }
+    void add_arg(size_t index, const bool& value) { begin_arg(index, tag_bool); append_value(value); }
+    void add_arg(size_t index, const char& value) { begin_arg(index, tag_char); append_value(value); }
+
+    void add_arg(size_t index, const std::string& value) {
+        begin_arg(index, tag_string);
+        append_string(value.data(), value.length());
+    }
+
+    void add_arg(size_t index, const char* const& value) {
+        begin_arg(index, tag_string);
+        append_string(value, std::strlen(value));
+    }
+
+    void add_arg(size_t index, char* const& value) {
+        add_arg(index, static_cast<const char*>(value));
+    }
+
+    template<size_t N>
+    void add_arg(size_t index, const char (&value)[N]) {
+        add_arg(index, static_cast<const char*>(value));
+    }
+
+    // Other arrays would be captured as the address of their first element
+    template<typename T, size_t N>
+    void add_arg(size_t /* index */, const T (& /* value */)[N]) {
+        static_assert(sizeof(T) == 0, "capture() takes no arrays other than character strings; pass a container");
+    }
+
+    // Values that refer to no other memory are stored by value and formatted later
+    template<typename T>
+    typename std::enable_if<detail::is_self_contained<T>::value>::type
+    add_arg(size_t index, const T& value) {
+        static_assert(sizeof(T) <= sizeof(trivial_storage), "self-contained type larger than trivial_storage");
+        begin_arg(index, tag_trivial);
+        trivial_format_fn fn = &detail::format_erased<T>;
+        append_value(fn);
+        std::uint32_t size = static_cast<std::uint32_t>(sizeof(T));
+        append_value(size);
+        buffer_.append(&value, sizeof(T));
+    }
+
+    // Anything else is converted to string at capture time, it may point to data
+    // that is gone by the time the record is formatted
+    template<typename T>
+    typename std::enable_if<!std::is_array<T>::value && !detail::is_self_contained<T>::value>::type
+    add_arg(size_t index, const T& value) {
+        add_arg(index, detail::to_string_impl(value));
+    }
+
+    void add_verbatim(size_t index, const std::string& value) {
+        begin_arg(index, tag_verbatim);
+        append_string(value.data(), value.length());
+    }
+
+    void add_var(bool found, const std::string& value) {
+        size_t before = buffer_.size();
+        unsigned char found_byte = found ? 1 : 0;
+        buffer_.append(&found_byte, 1);
+        append_string(value.data(), found ? value.length() : 0);
+        vars_size_ += buffer_.size() - before;
+    }
+
+    // ----- Decoding -----
+
+    template<typename Sink, typename T>
+    static void write_value(Sink& sink, const T& value, const compiled_template::segment& seg) {
+        if (seg.has_spec) {
+            detail::append_formatted(sink, value, seg.format);
+        } else {
+            std::string text = detail::to_string_impl(value);
+            sink.append(text.data(), text.length());
+        }
+    }
+
+    template<typename Sink>
+    static void write_var(Sink& sink, const char* value, size_t length, const compiled_template::segment& seg) {
+        if (seg.has_spec && !seg.spec.empty()) {
+            detail::append_text_formatted(sink, value, length, seg.format);
+        } else {
+            sink.append(value, length);
+        }
+    }
+
+    template<typename Sink>
+    void write_arg(Sink& sink, size_t offset, const compiled_template::segment& seg) const {
+        const char* payload = buffer_.data() + offset + 1;
+        size_t value_offset = offset + 1;
+        switch (static_cast<arg_tag>(buffer_.data()[offset])) {
+        case tag_int32:
+            write_value(sink, read<int>(value_offset), seg);
+            break;
+        case tag_int64:
+            write_value(sink, read<long long>(value_offset), seg);
+            break;
+        case tag_uint64:
+            write_value(sink, read<unsigned long long>(value_offset), seg);
+            break;
+        case tag_double:
+            write_value(sink, read<double>(value_offset), seg);
+            break;
+        case tag_bool:
+            write_value(sink, read<bool>(value_offset), seg);
+            break;
+        case tag_char:
+            write_value(sink, read<char>(value_offset), seg);
+            break;
+        case tag_string: {
+            std::uint32_t length = read<std::uint32_t>(value_offset);
+            const char* text = payload + sizeof(std::uint32_t);
+            if (seg.has_spec) {
+                detail::append_aligned(sink, text, length, seg.format);
+            } else {
+                sink.append(text, length);
+            }
+            break;
+        }
+        case tag_verbatim: {
+            std::uint32_t length = read<std::uint32_t>(value_offset);
+            sink.append(payload + sizeof(std::uint32_t), length);
+            break;
+        }
+        case tag_trivial: {
+            trivial_format_fn fn = read<trivial_format_fn>(value_offset);
+            std::uint32_t size = read<std::uint32_t>(value_offset + sizeof(trivial_format_fn));
+            trivial_storage storage;
+            std::memcpy(&storage, payload + sizeof(trivial_format_fn) + sizeof(std::uint32_t), size);
+            std::string text = fn(&storage, seg.has_spec ? &seg.format : nullptr);
+            sink.append(text.data(), text.length());
+            break;
+        }
+        }
+    }
+};
+
+// ========== Batch Formatting Types ==========
+
+/**
+ * @brief Contiguous output of a batch format call with per-row offsets
+ * @ingroup core
+ *
+ * All rows are written back to back into one buffer; row i occupies
+ * [offsets()[i], offsets()[i + 1]). Can also be used as a regular sink.
+ */
+class batch_output {
+public:
+    batch_output() : offsets_(1, 0) {}
+
+    /**
+     * @brief Append data to the current row
+     */
+    void append(const char* data, size_t size) {
+        buffer_.append(data, size);
+    }
+
+    /**
+     * @brief Terminate the current row
+     */
+    void end_row() {
+        offsets_.push_back(buffer_.size());
+    }
+
+    /**
+     * @brief Reserve space for rows and output bytes
+     */
+    void reserve(size_t rows, size_t bytes) {
+        offsets_.reserve(offsets_.size() + rows);
+        buffer_.reserve(buffer_.size() + bytes);
+    }
+
+    /**
+     * @brief Drop all rows, keeping capacity
+     */
+    void clear() {
+        buffer_.clear();
+        offsets_.assign(1, 0);
+    }
+
+    /**
+     * @brief Number of completed rows
+     */
+    size_t size() const { return offsets_.size() - 1; }
+
+    /**
+     * @brief Pointer to the first character of a row
+     */
+    const char* row_data(size_t index) const { return buffer_.data() + offsets_[index]; }
+
+    /**
+     * @brief Length of a row in bytes
+     */
+    size_t row_length(size_t index) const { return offsets_[index + 1] - offsets_[index]; }
+
+    /**
+     * @brief Copy of a row
+     */
+    std::string row(size_t index) const { return std::string(row_data(index), row_length(index)); }
+
+    /**
+     * @brief All rows, concatenated
+     */
+    const std::string& buffer() const { return buffer_; }
+
+    /**
+     * @brief Row start offsets followed by the end offset of the last row
+     */
+    const std::vector<size_t>& offsets() const { return offsets_; }
+
+private:
+    std::string buffer_;
+    std::vector<size_t> offsets_;
+};
+
+namespace detail {
+
+// Row of a column_set: column pointers plus row index
+template<typename... Cols>
+struct soa_row {
+    const std::tuple<const Cols*...>* columns;
+    size_t index;
+};
+
+// Random-access iterator over the rows of a column_set
+template<typename... Cols>
+class soa_iterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef soa_row<Cols...> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    soa_iterator(const std::tuple<const Cols*...>* columns, size_t index) : row_{columns, index} {}
+
+    reference operator*() const { return row_; }
+    soa_iterator& operator++() { ++row_.index; return *this; }
+    soa_iterator operator+(difference_type n) const {
+        return soa_iterator(row_.columns, row_.index + static_cast<size_t>(n));
+    }
+    difference_type operator-(const soa_iterator& other) const {
+        return static_cast<difference_type>(row_.index) - static_cast<difference_type>(other.row_.index);
+    }
+    bool operator==(const soa_iterator& other) const { return row_.index == other.row_.index; }
+    bool operator!=(const soa_iterator& other) const { return row_.index != other.row_.index; }
+
+private:
+    soa_row<Cols...> row_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Struct-of-arrays view over equally sized columns, see ufmt::columns()
+ * @ingroup core
+ *
+ * Holds references to the columns; they must outlive the view. Column i is
+ * referenced by positional placeholder {i}.
+ */
+template<typename... Cols>
+class column_set {
+public:
+    explicit column_set(const Cols&... cols) : columns_(&cols...), size_(min_size(cols...)) {}
+
+    /**
+     * @brief Number of rows (length of the shortest column)
+     */
+    size_t size() const { return size_; }
+
+    const std::tuple<const Cols*...>& columns() const { return columns_; }
+
+    detail::soa_iterator<Cols...> begin() const { return detail::soa_iterator<Cols...>(&columns_, 0); }
+    detail::soa_iterator<Cols...> end() const { return detail::soa_iterator<Cols...>(&columns_, size_); }
+
+private:
+    std::tuple<const Cols*...> columns_;
+    size_t size_;
+
+    static size_t min_size() { return 0; }
+
+    template<typename Col>
+    static size_t min_size(const Col& col) { return col.size(); }
+
+    template<typename Col, typename... Rest>
+    static size_t min_size(const Col& col, const Rest&... rest) {
+        return std::min(static_cast<size_t>(col.size()), min_size(rest...));
+    }
+};
+
+/**
+ * @brief Create a struct-of-arrays view for format_batch()
+ * @ingroup core
+ * @param cols Random-access containers (std::vector, std::array, ...)
+ */
+template<typename... Cols>
+column_set<Cols...> columns(const Cols&... cols) {
+    return column_set<Cols...>(cols...);
+}
+
+namespace detail {
+
+template<typename Row, typename Sink>
+class batch_plan;
+
+// Row boundaries are only recorded by batch_output
+template<typename Sink>
+void end_batch_row(Sink& /* sink */) {
+}
+
+inline void end_batch_row(batch_output& sink) {
+    sink.end_row();
+}
+
+template<typename Sink>
+void reserve_batch(Sink& /* sink */, size_t /* rows */, size_t /* bytes */) {
+}
+
+inline void reserve_batch(batch_output& sink, size_t rows, size_t bytes) {
+    sink.reserve(rows, bytes);
+}
+
+template<typename Sink>
+size_t batch_bytes(const Sink& /* sink */) {
+    return 0;
+}
+
+inline size_t batch_bytes(const batch_output& sink) {
+    return sink.buffer().size();
+}
+
+// A profiled batch keeps the row handling of the wrapped sink
+template<typename Sink>
+void end_batch_row(counting_sink<Sink>& sink) {
+    end_batch_row(sink.inner());
+}
+
+template<typename Sink>
+void reserve_batch(counting_sink<Sink>& sink, size_t rows, size_t bytes) {
+    reserve_batch(sink.inner(), rows, bytes);
+}
+
+template<typename Sink>
+size_t batch_bytes(const counting_sink<Sink>& sink) {
+    return batch_bytes(sink.inner());
+}
+
+// C++11 replacement for std::index_sequence
+template<size_t... I>
+struct index_sequence {};
+
+template<size_t N, size_t... I>
+struct make_index_sequence : make_index_sequence<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct make_index_sequence<0, I...> {
+    typedef index_sequence<I...> type;
+};
+
+/**
+ * @brief Field access for batch rows (std::tuple, std::pair, soa_row)
+ */
+template<typename Row>
+struct row_traits;
+
+template<typename... Ts>
+struct row_traits<std::tuple<Ts...>> {
+    static const size_t size = sizeof...(Ts);
+
+    template<size_t I>
+    using field_type = typename std::tuple_element<I, std::tuple<Ts...>>::type;
+
+    template<size_t I>
+    static const field_type<I>& get(const std::tuple<Ts...>& row) {
+        return std::get<I>(row);
+    }
+};
+
+template<typename A, typename B>
+struct row_traits<std::pair<A, B>> {
+    static const size_t size = 2;
+
+    template<size_t I>
+    using field_type = typename std::tuple_element<I, std::pair<A, B>>::type;
+
+    template<size_t I>
+    static const field_type<I>& get(const std::pair<A, B>& row) {
+        return std::get<I>(row);
+    }
+};
+
+template<typename... Cols>
+struct row_traits<soa_row<Cols...>> {
+    static const size_t size = sizeof...(Cols);
+
+    template<size_t I>
+    using field_type = typename std::tuple_element<I, std::tuple<Cols...>>::type::value_type;
+
+    // By value for proxies such as std::vector<bool>, by reference otherwise
+    template<size_t I>
+    static auto get(const soa_row<Cols...>& row) -> decltype((*std::get<I>(*row.columns))[row.index]) {
+        return (*std::get<I>(*row.columns))[row.index];
+    }
+};
+
+} // namespace detail
+
+// ========== Runtime Statistics ==========
+
+/**
+ * @brief Formatting activity counters, see ufmt::stats() and format_context_base::stats()
+ * @ingroup core
+ *
+ * Counters are only maintained when UFMT_ENABLE_STATS is defined (CMake option
+ * UFMT_ENABLE_STATS) and are zero otherwise. The storage sizes are computed on
+ * request and are reported for a single context only.
+ */
+struct format_stats {
+    unsigned long long format_calls = 0;        ///< format(), format_to(), vformat() and format_json() calls
+    unsigned long long bytes_formatted = 0;     ///< Output bytes of those calls (before escaping by format_json())
+    unsigned long long var_lookups = 0;         ///< Named variable lookups
+    unsigned long long var_hits = 0;            ///< Lookups that found the variable
+    unsigned long long custom_formats = 0;      ///< Custom formatter invocations
+    unsigned long long captures = 0;            ///< capture() calls
+    unsigned long long batch_rows = 0;          ///< Rows written by format_batch() and parallel_format_batch()
+    unsigned long long templates_compiled = 0;  ///< Parsed compiled_template objects (process-wide only)
+    unsigned long long template_cache_hits = 0; ///< format() calls whose template the thread had compiled (process-wide only)
+    size_t var_bytes = 0;                       ///< Approximate heap bytes held by the context's variables
+    size_t formatter_bytes = 0;                 ///< Approximate heap bytes held by the context's formatter map
+
+    unsigned long long var_misses() const { return var_lookups - var_hits; }
+};
+
+namespace detail {
+
+enum stat_id {
+    stat_format_calls,
+    stat_bytes_formatted,
+    stat_var_lookups,
+    stat_var_hits,
+    stat_custom_formats,
+    stat_captures,
+    stat_batch_rows,
+    stat_templates_compiled,
+    stat_template_cache_hits,
+    stat_count
+};
+
+// Copy the counters of a stat_id-indexed array into a format_stats
+inline void store_stats(const unsigned long long (&values)[stat_count], format_stats& stats) {
+    stats.format_calls = values[stat_format_calls];
+    stats.bytes_formatted = values[stat_bytes_formatted];
+    stats.var_lookups = values[stat_var_lookups];
+    stats.var_hits = values[stat_var_hits];
+    stats.custom_formats = values[stat_custom_formats];
+    stats.captures = values[stat_captures];
+    stats.batch_rows = values[stat_batch_rows];
+    stats.templates_compiled = values[stat_templates_compiled];
+    stats.template_cache_hits = values[stat_template_cache_hits];
+}
+
+#ifdef UFMT_ENABLE_STATS
+
+// One counter per stat_id, on cache lines of its own so that adjacent blocks never share one
+struct alignas(64) stat_block {
+    std::atomic<unsigned long long> values[stat_count];
+
+    stat_block() {
+        for (size_t i = 0; i < stat_count; ++i) {
+            values[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add_to(unsigned long long (&totals)[stat_count]) const {
+        for (size_t i = 0; i < stat_count; ++i) {
+            totals[i] += values[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * @brief Process-wide counters of the calling thread
+ *
+ * Only the owning thread writes its block, with plain relaxed loads and stores
+ * (no read-modify-write); ufmt::stats() sums the blocks of all live threads
+ * and the totals of threads that have exited.
+ */
+struct thread_stat_state {
+    stat_block block;
+    size_t ordinal;  // Selects the shard of per-context counters
+
+    thread_stat_state();
+    ~thread_stat_state();
+
+    thread_stat_state(const thread_stat_state&) = delete;
+    thread_stat_state& operator=(const thread_stat_state&) = delete;
+};
+
+struct stat_registry {
+    std::mutex mutex;
+    std::vector<const stat_block*> threads;
+    unsigned long long retired[stat_count];
+    size_t next_ordinal;
+};
+
+UFMT_DECL stat_registry& stats_registry();
+UFMT_DECL thread_stat_state& thread_stats();
+
+inline void add_thread_stat(stat_block& block, stat_id id, unsigned long long n) {
+    block.values[id].store(block.values[id].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Count an event that belongs to no context
+inline void add_global_stat(stat_id id, unsigned long long n = 1) {
+    add_thread_stat(thread_stats().block, id, n);
+}
+
+/**
+ * @brief Counters of one context, sharded by thread to keep shared contexts scalable
+ *
+ * Every event is also added to the process-wide counters of the calling thread.
+ */
+class stat_counters {
+public:
+    static const size_t shard_count = 8;
+
+    stat_counters() : storage_(new char[sizeof(stat_block) * shard_count + alignof(stat_block)]),
+                      shards_(align_shards(storage_.get())) {}
+
+    // Copies and moves of a context keep its counts
+    stat_counters(const stat_counters& other) : stat_counters() { copy_from(other); }
+
+    stat_counters& operator=(const stat_counters& other) {
+        copy_from(other);
+        return *this;
+    }
+
+    void add(stat_id id, unsigned long long n = 1) const {
+        thread_stat_state& state = thread_stats();
+        add_thread_stat(state.block, id, n);
+        shards_[state.ordinal % shard_count].values[id].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void snapshot(format_stats& stats) const {
+        unsigned long long totals[stat_count] = {};
+        for (size_t s = 0; s < shard_count; ++s) {
+            shards_[s].add_to(totals);
+        }
+        store_stats(totals, stats);
+    }
+
+private:
+    // The shards get an allocation of their own: before C++17 operator new ignores
+    // alignas(64), so an inline array would not start on a cache line
+    std::unique_ptr<char[]> storage_;
+    stat_block* shards_;
+
+    static stat_block* align_shards(char* storage) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(storage);
+        size_t skip = (alignof(stat_block) - address % alignof(stat_block)) % alignof(stat_block);
+        stat_block* shards = reinterpret_cast<stat_block*>(storage + skip);
+        for (size_t s = 0; s < shard_count; ++s) {
+            new (shards + s) stat_block();
+        }
+        return shards;
+    }
+
+    void copy_from(const stat_counters& other) {
+        for (size_t s = 0; s < shard_count; ++s) {
+            for (size_t i = 0; i < stat_count; ++i) {
+                shards_[s].values[i].store(other.shards_[s].values[i].load(std::memory_order_relaxed),
+                                           std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+#else
+
+inline void add_global_stat(stat_id /* id */, unsigned long long /* n */ = 1) {}
+
+// Statistics disabled: counting compiles to nothing
+class stat_counters {
+public:
+    void add(stat_id /* id */, unsigned long long /* n */ = 1) const {}
+    void snapshot(format_stats& /* stats */) const {}
+};
+
+#endif
+
+// Heap bytes owned by a string (0 while the text fits the small-string buffer)
+inline size_t string_heap_bytes(const std::string& text) {
+    const char* data = text.data();
+    const char* object = reinterpret_cast<const char*>(&text);
+    bool inline_buffer = data >= object && data < object + sizeof(text);
+    return inline_buffer ? 0 : text.capacity() + 1;
+}
+
+// Approximate heap bytes of an unordered_map: bucket array plus one node per element
+template<typename Map>
+size_t hash_map_bytes(const Map& map) {
+    return map.bucket_count() * sizeof(void*) +
+           map.size() * (sizeof(typename Map::value_type) + sizeof(void*) + sizeof(size_t));
+}
+
+inline size_t var_map_bytes(const std::unordered_map<std::string, var_value>& variables) {
+    size_t bytes = hash_map_bytes(variables);
+    for (const auto& var : variables) {
+        bytes += string_heap_bytes(var.first) + string_heap_bytes(var.second.text);
+    }
+    return bytes;
+}
+
+} // namespace detail
+
+/**
+ * @brief Whether the library was built with UFMT_ENABLE_STATS
+ * @ingroup core
+ */
+inline bool stats_enabled() {
+#ifdef UFMT_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Process-wide formatting counters, summed over all threads
+ * @ingroup core
+ *
+ * Includes the activity of every context and of the free functions. Storage
+ * sizes are not aggregated and stay zero. All counters are zero unless
+ * UFMT_ENABLE_STATS is defined.
+ */
+UFMT_DECL format_stats stats();
+
+// ========== Lock Instrumentation ==========
+
+/**
+ * @brief Usage of one instrumented mutex, see ufmt::lock_stats()
+ * @ingroup core
+ */
+struct mutex_stats {
+    std::string name;                       ///< Context name, "context_manager", or empty for unnamed shared contexts
+    unsigned long long acquisitions = 0;    ///< Successful lock() and try_lock() calls
+    unsigned long long contended = 0;       ///< lock() calls that found the mutex held and had to wait
+    unsigned long long wait_ns = 0;         ///< Total time spent waiting in contended lock() calls
+    unsigned long long hold_ns = 0;         ///< Total time the mutex was held
+    unsigned long long max_hold_ns = 0;     ///< Longest single hold
+};
+
+namespace detail {
+
+#ifdef UFMT_ENABLE_LOCK_STATS
+
+/**
+ * @brief std::mutex that records acquisitions, contention, wait and hold times
+ *
+ * An uncontended lock() costs a try_lock() plus one clock read; only contended
+ * acquisitions time the wait. Counters are written while the mutex is held and
+ * can be read at any time. Live instances are listed by ufmt::lock_stats().
+ */
+class instrumented_mutex {
+public:
+    instrumented_mutex();
+    ~instrumented_mutex();
+
+    instrumented_mutex(const instrumented_mutex&) = delete;
+    instrumented_mutex& operator=(const instrumented_mutex&) = delete;
+
+    void lock() {
+        if (!mutex_.try_lock()) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            mutex_.lock();
+            hold_start_ = std::chrono::steady_clock::now();
+            add(contended_, 1);
+            add(wait_ns_, elapsed_ns(start, hold_start_));
+        } else {
+            hold_start_ = std::chrono::steady_clock::now();
+        }
+        add(acquisitions_, 1);
+    }
+
+    bool try_lock() {
+        if (!mutex_.try_lock()) {
+            return false;
+        }
+        hold_start_ = std::chrono::steady_clock::now();
+        add(acquisitions_, 1);
+        return true;
+    }
+
+    void unlock() {
+        unsigned long long held = elapsed_ns(hold_start_, std::chrono::steady_clock::now());
+        add(hold_ns_, held);
+        if (held > max_hold_ns_.load(std::memory_order_relaxed)) {
+            max_hold_ns_.store(held, std::memory_order_relaxed);
+        }
+        mutex_.unlock();
+    }
+
+    void set_name(const std::string& name);
+
+    mutex_stats stats() const;
+
+    // stats() for callers already holding the registry mutex
+    mutex_stats registered_stats() const;
+
+private:
+    std::mutex mutex_;
+    std::string name_;  // Guarded by the registry mutex
+    std::chrono::steady_clock::time_point hold_start_;
+    std::atomic<unsigned long long> acquisitions_;
+    std::atomic<unsigned long long> contended_;
+    std::atomic<unsigned long long> wait_ns_;
+    std::atomic<unsigned long long> hold_ns_;
+    std::atomic<unsigned long long> max_hold_ns_;
+
+    // Single writer (the lock holder): no read-modify-write needed
+    static void add(std::atomic<unsigned long long>& counter, unsigned long long n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static unsigned long long elapsed_ns(std::chrono::steady_clock::time_point from,
+                                         std::chrono::steady_clock::time_point to) {
+        return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+    }
+};
+
+struct mutex_registry {
+    std::mutex mutex;
+    std::vector<const instrumented_mutex*> mutexes;
+};
+
+UFMT_DECL mutex_registry& lock_registry();
+
+// Mutex of shared contexts and of the context manager registry
+typedef instrumented_mutex context_mutex;
+
+inline void set_mutex_name(instrumented_mutex& mutex, const std::string& name) {
+    mutex.set_name(name);
+}
+
+inline mutex_stats stats_of(const instrumented_mutex& mutex) {
+    return mutex.stats();
+}
+
+#else
+
+typedef std::mutex context_mutex;
+
+inline void set_mutex_name(std::mutex& /* mutex */, const std::string& /* name */) {}
+
+inline mutex_stats stats_of(const std::mutex& /* mutex */) {
+    return mutex_stats();
+}
+
+#endif
+
+} // namespace detail
+
+/**
+ * @brief Whether the library was built with UFMT_ENABLE_LOCK_STATS
+ * @ingroup core
+ */
+inline bool lock_stats_enabled() {
+#ifdef UFMT_ENABLE_LOCK_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Usage of the mutexes of all live shared contexts and the context manager
+ * @ingroup core
+ * @return One entry per mutex, most total wait time first; empty unless
+ *         UFMT_ENABLE_LOCK_STATS is defined
+ *
+ * Contexts obtained from get_shared_context() are reported under their name.
+ */
+UFMT_DECL std::vector<mutex_stats> lock_stats();
+
+// ========== Type-Erased Arguments ==========
+
+/**
+ * @brief Reference to one format argument with its type tag
+ * @ingroup core
+ *
+ * Holds the address of the argument, which must outlive the format_arg, and
+ * its std::type_info for custom formatter lookup. Built-in types are decoded
+ * by tag; any other type carries a function that formats it.
+ */
+struct format_arg {
+    enum arg_tag : unsigned char {
+        tag_none,
+        tag_int,
+        tag_long,
+        tag_long_long,
+        tag_uint,
+        tag_ulong,
+        tag_ulong_long,
+        tag_float,
+        tag_double,
+        tag_bool,
+        tag_char,
+        tag_string,      // std::string
+        tag_c_string,    // const char* or char* variable
+        tag_char_array,  // Character array, value points to the first character
+        tag_other        // Formatted by format
+    };
+
+    const void* value;
+    const std::type_info* type;
+    detail::erased_format_fn format;
+    arg_tag tag;
+
+    format_arg() : value(nullptr), type(&typeid(void)), format(nullptr), tag(tag_none) {}
+
+    format_arg(const void* arg_value, const std::type_info& arg_type, arg_tag arg_tag_value,
+               detail::erased_format_fn arg_format = nullptr)
+        : value(arg_value), type(&arg_type), format(arg_format), tag(arg_tag_value) {}
+};
+
+/**
+ * @brief Fixed-size array of format arguments, see make_format_args()
+ * @ingroup core
+ */
+template<size_t N>
+struct format_arg_store {
+    format_arg args[N > 0 ? N : 1];
+};
+
+/**
+ * @brief View of packed format arguments passed to the vformat() functions
+ * @ingroup core
+ *
+ * Does not own the arguments; usually built from the temporary returned by
+ * make_format_args() within the same expression.
+ */
+class format_args {
+public:
+    format_args() : data_(nullptr), size_(0) {}
+
+    format_args(const format_arg* data, size_t size) : data_(data), size_(size) {}
+
+    template<size_t N>
+    format_args(const format_arg_store<N>& store) : data_(store.args), size_(N) {}
+
+    size_t size() const { return size_; }
+
+    const format_arg& operator[](size_t index) const { return data_[index]; }
+
+private:
+    const format_arg* data_;
+    size_t size_;
+};
+
+namespace detail {
+
+template<typename T>
+struct is_c_string : std::integral_constant<bool, std::is_same<T, const char*>::value || std::is_same<T, char*>::value> {};
+
+// Packing overloads: built-in types are tagged, anything else gets format_erased<T>
+template<typename T>
+typename std::enable_if<!is_c_string<T>::value, format_arg>::type
+make_format_arg(const T& value) {
+    return format_arg(&value, typeid(T), format_arg::tag_other, &format_erased<T>);
+}
+
+// A template, so character arrays do not bind to it through a temporary pointer
+template<typename T>
+typename std::enable_if<is_c_string<T>::value, format_arg>::type
+make_format_arg(const T& value) {
+    return format_arg(&value, typeid(T), format_arg::tag_c_string);
+}
+
+inline format_arg make_format_arg(const int& value) { return format_arg(&value, typeid(int), format_arg::tag_int); }
+inline format_arg make_format_arg(const long& value) { return format_arg(&value, typeid(long), format_arg::tag_long); }
+inline format_arg make_format_arg(const long long& value) { return format_arg(&value, typeid(long long), format_arg::tag_long_long); }
+inline format_arg make_format_arg(const unsigned int& value) { return format_arg(&value, typeid(unsigned int), format_arg::tag_uint); }
+inline format_arg make_format_arg(const unsigned long& value) { return format_arg(&value, typeid(unsigned long), format_arg::tag_ulong); }
+inline format_arg make_format_arg(const unsigned long long& value) {
+    return format_arg(&value, typeid(unsigned long long), format_arg::tag_ulong_long);
+}
+inline format_arg make_format_arg(const float& value) { return format_arg(&value, typeid(float), format_arg::tag_float); }
+inline format_arg make_format_arg(const double& value) { return format_arg(&value, typeid(double), format_arg::tag_double); }
+inline format_arg make_format_arg(const bool& value) { return format_arg(&value, typeid(bool), format_arg::tag_bool); }
+inline format_arg make_format_arg(const char& value) { return format_arg(&value, typeid(char), format_arg::tag_char); }
+inline format_arg make_format_arg(const std::string& value) { return format_arg(&value, typeid(std::string), format_arg::tag_string); }
+
+template<size_t N>
+format_arg make_format_arg(const char (&value)[N]) {
+    return format_arg(value, typeid(value), format_arg::tag_char_array);
+}
+
+/**
+ * @brief Sink reference with a type-erased append, used by the vformat core
+ */
+class sink_ref {
+public:
+    template<typename Sink>
+    explicit sink_ref(Sink& sink) : sink_(&sink), append_(&append_to<Sink>) {}
+
+#if defined(UFMT_ENABLE_STATS) || defined(UFMT_ENABLE_PROFILING)
+    void append(const char* data, size_t size) {
+        written_ += size;
+        append_(sink_, data, size);
+    }
+
+    // Bytes appended so far, for format_stats::bytes_formatted and profiles
+    size_t written() const { return written_; }
+#else
+    void append(const char* data, size_t size) { append_(sink_, data, size); }
+
+    size_t written() const { return 0; }
+#endif
+
+private:
+    void* sink_;
+    void (*append_)(void* sink, const char* data, size_t size);
+#if defined(UFMT_ENABLE_STATS) || defined(UFMT_ENABLE_PROFILING)
+    size_t written_ = 0;
+#endif
+
+    template<typename Sink>
+    static void append_to(void* sink, const char* data, size_t size) {
+        static_cast<Sink*>(sink)->append(data, size);
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Pack arguments for the vformat() functions
+ * @ingroup core
+ * @param args Arguments, referenced (not copied): the result must not outlive them
+ *
+ * Example:
+ *   std::string s = ufmt::vformat("{0} = {1:.2f}", ufmt::make_format_args(name, value));
+ */
+template<typename... Args>
+format_arg_store<sizeof...(Args)> make_format_args(const Args&... args) {
+    format_arg_store<sizeof...(Args)> store = {{detail::make_format_arg(args)...}};
+    return store;
+}
+
+// ========== Base Context Interface ==========
+
+/**
+ * @brief Base class for all formatting contexts - provides core formatting logic
+ * @ingroup contexts
+ *
+ * The format() method supports the following format string features:
+ *   - Positional and named placeholders: {0}, {name}
+ *   - Alignment: '-' (left), '^' (center), default (right)
+ *   - Width: {name:10} (pads to width 10)
+ *   - Truncation: {name:.8} (truncate string to 8 chars, ellipsis if >3)
+ *   - Center alignment: {name:^10}
  *   - Printf-style type specifiers: {val:08x}, {num:10.2f}
  *
  * See FormatSpec for details and examples.
@@ -736,7 +3227,114 @@ public:
      */
     template<typename... Args>
     std::string format(const std::string& template_str, Args&&... args) {
-        return format_impl(template_str, std::forward<Args>(args)...);
+        return vformat(template_str, make_format_args(args...));
+    }
+    
+    /**
+     * @brief Format and append the result to a sink
+     * @param sink Any object providing append(const char*, size_t), e.g. std::string or fd_sink
+     * @param template_str Template string with placeholders
+     * @param args Variadic arguments to substitute
+     */
+    template<typename Sink, typename... Args>
+    void format_to(Sink& sink, const std::string& template_str, Args&&... args) {
+        vformat_impl_to(sink, default_escape_, template_str, make_format_args(args...));
+    }
+    
+    /**
+     * @brief Format with packed arguments
+     * @param template_str Template string with placeholders
+     * @param args Arguments packed with make_format_args()
+     * @return Formatted string
+     *
+     * Non-template core of format(): the variadic overloads only pack their
+     * arguments, so each call site instantiates a few lines of code.
+     */
+    std::string vformat(const std::string& template_str, format_args args);
+    
+    /**
+     * @brief Format with packed arguments and append the result to a sink
+     * @param sink Any object providing append(const char*, size_t)
+     * @param template_str Template string with placeholders
+     * @param args Arguments packed with make_format_args()
+     */
+    template<typename Sink>
+    void vformat_to(Sink& sink, const std::string& template_str, format_args args) {
+        vformat_impl_to(sink, default_escape_, template_str, args);
+    }
+    
+    /**
+     * @brief Capture arguments for deferred formatting
+     * @param tmpl Compiled template (must outlive the returned record)
+     * @param args Arguments to capture
+     * @return Self-contained record, see format_record
+     *
+     * Custom formatters and named variables of this context are resolved
+     * immediately; everything else is serialized and formatted later by
+     * format_record::format_to().
+     */
+    template<typename... Args>
+    format_record capture(const compiled_template& tmpl, Args&&... args) {
+        stats_.add(detail::stat_captures);
+        format_record record;
+        record.start(&tmpl, sizeof...(Args), default_escape_);
+        capture_args(record, 0, std::forward<Args>(args)...);
+        if (tmpl.named_count() > 0) {
+            capture_vars(record, tmpl);
+        }
+        return record;
+    }
+    
+    /**
+     * @brief Capture arguments for deferred formatting (record shares template ownership)
+     */
+    template<typename... Args>
+    format_record capture(const std::shared_ptr<const compiled_template>& tmpl, Args&&... args) {
+        format_record record = capture(*tmpl, std::forward<Args>(args)...);
+        record.owner_ = tmpl;
+        return record;
+    }
+    
+    /**
+     * @brief Capture arguments for deferred formatting (compiles the template)
+     */
+    template<typename... Args>
+    format_record capture(const std::string& template_str, Args&&... args) {
+        return capture(compile(template_str), std::forward<Args>(args)...);
+    }
+    
+    /**
+     * @brief Format one template over many rows, appending all output to a sink
+     * @param tmpl Compiled template; {i} refers to field i of a row
+     * @param rows Range of std::tuple / std::pair rows, or a ufmt::columns() set
+     * @param sink Any sink; with batch_output per-row offsets are recorded
+     *
+     * Template segments, field accessors, custom formatters and named variables
+     * are resolved once per call; the per-row loop only appends literal runs and
+     * formats fields.
+     */
+    template<typename Range, typename Sink>
+    void format_batch(const compiled_template& tmpl, const Range& rows, Sink& sink) {
+        typedef typename std::decay<decltype(*std::begin(rows))>::type row_type;
+#ifdef UFMT_ENABLE_PROFILING
+        detail::profile_scope profile(tmpl);
+        detail::counting_sink<Sink> counted(sink);
+        detail::batch_plan<row_type, detail::counting_sink<Sink>> plan(*this, tmpl);
+        plan.write_rows(std::begin(rows), std::end(rows), counted);
+        profile.finish(counted.count());
+#else
+        detail::batch_plan<row_type, Sink> plan(*this, tmpl);
+        plan.write_rows(std::begin(rows), std::end(rows), sink);
+#endif
+    }
+    
+    /**
+     * @brief Format one template over many rows (template from the thread's template cache)
+     */
+    template<typename Rows, typename Sink>
+    void format_batch(const std::string& template_str, const Rows& rows, Sink& sink) {
+        std::unique_ptr<compiled_template> uncached;
+        format_batch(detail::cached_template(template_str, uncached), rows, sink);
     }
     
     /**
@@ -745,6 +3343,32 @@ public:
      * @return true if variable exists
      */
     virtual bool has_var(const std::string& name) const = 0;
+    
+    /**
+     * @brief Set the escaping applied to placeholders without a modifier
+     * @param mode Escape mode; {name!raw} opts a single placeholder out
+     *
+     * Configuration setting: set it before the context is used from several threads.
+     */
+    void set_escape_mode(escape_mode mode) { default_escape_ = mode; }
+    
+    /**
+     * @brief Escaping applied to placeholders without a modifier
+     */
+    escape_mode get_escape_mode() const { return default_escape_; }
+    
+    /**
+     * @brief Formatting counters of this context and its storage size
+     *
+     * Counters are zero unless UFMT_ENABLE_STATS is defined; storage sizes are
+     * always computed. See format_stats.
+     */
+    format_stats stats() const {
+        format_stats result;
+        stats_.snapshot(result);
+        add_storage_stats(result);
+        return result;
+    }
 
 protected:
     /**
@@ -764,6 +3388,23 @@ protected:
      */
     virtual std::string format_value_custom(std::type_index type, const void* value, const std::string& formatSpec) const = 0;
 
+    /**
+     * @brief Get a copy of the custom formatter for a type (empty if none)
+     *
+     * Default implementation forwards to format_value_custom() of this context.
+     */
+    virtual std::function<std::string(const void*)> get_formatter_impl(std::type_index type) const {
+        if (!has_formatter_impl(type)) {
+            return std::function<std::string(const void*)>();
+        }
+        return [this, type](const void* value) { return format_value_custom(type, value, ""); };
+    }
+
+    /**
+     * @brief Fill in the storage sizes reported by stats()
+     */
+    virtual void add_storage_stats(format_stats& /* stats */) const {}
+    
     // Add find_var to base for override
     virtual std::pair<bool, std::string> find_var(const std::string& name) const {
         // Default: use has_var + get_var (may double lock, but only for non-shared_context)
@@ -774,137 +3415,71 @@ protected:
     }
 
 private:
-    // Helper function to convert values to string
-    template<typename T>
-    std::string to_string(const T& value) const {
-        // Check if custom formatter exists
-        std::type_index type_idx(typeid(T));
-        if (has_formatter_impl(type_idx)) {
-            return format_value_custom(type_idx, &value, "");
-        }
-        
-        // Use default conversion
-        return detail::to_string_impl(value);
+    template<typename Row, typename Sink>
+    friend class detail::batch_plan;
+    
+    escape_mode default_escape_ = escape_mode::none;
+    detail::stat_counters stats_;
+    
+protected:
+    /**
+     * @brief Format into a sink
+     * @param escape Escaping for placeholders without a modifier
+     */
+    template<typename Sink, typename... Args>
+    void format_impl_to(Sink& sink, escape_mode escape, const std::string& template_str, Args&&... args) {
+        vformat_impl_to(sink, escape, template_str, make_format_args(args...));
     }
     
-    template<typename... Args>
-    std::string format_impl(const std::string& template_str, Args&&... args) {
-        std::string result = template_str;
-        
-        // Store arguments as strings with their formatters
-        std::vector<std::pair<std::string, std::function<std::string(const std::string&)>>> formattedArgs;
-        if (sizeof...(args) > 0) {
-            add_args_to_vector(formattedArgs, std::forward<Args>(args)...);
-        } else {
-            add_args_to_vector(formattedArgs); // No-argument version
-        }
-        
-        // Replace {0}, {1}, {0:.2f}, etc. with actual arguments
-        for (size_t i = 0; i < formattedArgs.size(); ++i) {
-            // Look for formatted placeholders like {0:.2f}
-            std::string formatPattern = "{" + std::to_string(i) + ":";
-            size_t pos = 0;
-            while ((pos = result.find(formatPattern, pos)) != std::string::npos) {
-                // Find the closing brace
-                size_t endPos = result.find("}", pos);
-                if (endPos != std::string::npos) {
-                    // Extract format specifier (e.g., ".2f")
-                    std::string formatSpec = result.substr(pos + formatPattern.length(), 
-                                                          endPos - pos - formatPattern.length());
-                    std::string placeholder = result.substr(pos, endPos - pos + 1);
-                    
-                    // Apply formatting using the stored formatter
-                    std::string formattedValue = formattedArgs[i].second(formatSpec);
-                    result.replace(pos, placeholder.length(), formattedValue);
-                    pos += formattedValue.length();
-                } else {
-                    break;
-                }
-            }
-            
-            // Look for simple placeholders like {0}
-            std::string simplePlaceholder = "{" + std::to_string(i) + "}";
-            pos = 0;
-            while ((pos = result.find(simplePlaceholder, pos)) != std::string::npos) {
-                result.replace(pos, simplePlaceholder.length(), formattedArgs[i].first);
-                pos += formattedArgs[i].first.length();
-            }
-        }
-        
-        {
-            // Replace named variables like {variable_name} and {variable_name:.2f}
-            size_t pos = 0;
-            while ((pos = result.find("{", pos)) != std::string::npos) {
-                size_t endPos = result.find("}", pos);
-                if (endPos != std::string::npos) {
-                    std::string placeholder = result.substr(pos + 1, endPos - pos - 1);
-                    // Skip if it's a positional placeholder (already processed)
-                    if (placeholder.empty() || std::isdigit(placeholder[0])) {
-                        pos = endPos + 1;
-                        continue;
-                    }
-                    // Check if it has a format specifier
-                    size_t colonPos = placeholder.find(':');
-                    std::string varName = placeholder;
-                    std::string formatSpec;
-                    if (colonPos != std::string::npos) {
-                        varName = placeholder.substr(0, colonPos);
-                        formatSpec = placeholder.substr(colonPos + 1);
-                    }
-                    // Use find_var for optimized lookup (single lock in shared_context)
-                    auto found = find_var(varName);
-                    if (found.first) {
-                        std::string value = found.second;
-                        if (!formatSpec.empty()) {
-                            value = detail::apply_format(value, formatSpec);
-                        }
-                        result.replace(pos, endPos - pos + 1, value);
-                        pos += value.length();
-                    } else {
-                        pos = endPos + 1;
-                    }
-                } else {
-                    break;
-                }
-            }
-        }
-        
-        return result;
+    /**
+     * @brief Format packed arguments into a sink
+     *
+     * std::string output and sink_ref are the non-template entry points;
+     * other sinks are wrapped in a sink_ref.
+     */
+    void vformat_impl_to(std::string& sink, escape_mode escape, const std::string& template_str, format_args args);
+    void vformat_impl_to(detail::sink_ref& sink, escape_mode escape, const std::string& template_str, format_args args);
+    
+    template<typename Sink>
+    void vformat_impl_to(Sink& sink, escape_mode escape, const std::string& template_str, format_args args) {
+        detail::sink_ref ref(sink);
+        vformat_impl_to(ref, escape, template_str, args);
     }
     
-    // Recursive helper to convert arguments to formatted pairs (C++11 compatible)
-    // Base case: no arguments
-    void add_args_to_vector(std::vector<std::pair<std::string, std::function<std::string(const std::string&)>>>& /* vec */) {
-        // Empty base case - do nothing
+private:
+    // Body of vformat_impl_to(), defined in ufmt_impl.h for the two sink types above
+    template<typename Sink>
+    void vformat_core(Sink& sink, escape_mode escape, const compiled_template& tmpl, format_args args);
+    
+    template<typename Sink>
+    void write_arg(Sink& sink, const format_arg& arg, const FormatSpec* spec, escape_mode escape) const;
+    
+    // Recursive helpers to serialize arguments into a format_record
+    void capture_args(format_record& /* record */, size_t /* index */) {
     }
     
-    template<typename T>
-    void add_args_to_vector(std::vector<std::pair<std::string, std::function<std::string(const std::string&)>>>& vec, T&& arg) {
-        // Use a different name to avoid shadowing
+    template<typename T, typename... Rest>
+    void capture_args(format_record& record, size_t index, T&& first, Rest&&... rest) {
         std::type_index type_idx(typeid(T));
-        std::string stringValue;
         if (has_formatter_impl(type_idx)) {
-            stringValue = format_value_custom(type_idx, &arg, ""); // Use custom formatter for default string representation
+            stats_.add(detail::stat_custom_formats);
+            record.add_verbatim(index, format_value_custom(type_idx, &first, ""));
         } else {
-            stringValue = to_string(arg);
+            record.add_arg(index, first);
         }
-        
-        // Create formatter function for this argument
-        auto formatter = [this, arg](const std::string& formatSpec) -> std::string {
-            // Use a different name to avoid shadowing
-            std::type_index type_idx_lambda(typeid(T));
-            if (has_formatter_impl(type_idx_lambda)) {
-                return format_value_custom(type_idx_lambda, &arg, formatSpec);
-            }
-            return detail::format_value(arg, formatSpec);
-        };
-        vec.emplace_back(stringValue, formatter);
+        capture_args(record, index + 1, std::forward<Rest>(rest)...);
     }
-
-    template<typename T, typename... Args>
-    void add_args_to_vector(std::vector<std::pair<std::string, std::function<std::string(const std::string&)>>>& vec, T&& first, Args&&... rest) {
-        add_args_to_vector(vec, std::forward<T>(first));
-        add_args_to_vector(vec, std::forward<Args>(rest)...);
+    
+    // Snapshot named variables referenced by the template, in template order
+    void capture_vars(format_record& record, const compiled_template& tmpl) const {
+        for (const auto& seg : tmpl.segments()) {
+            if (seg.kind == compiled_template::segment_kind::named) {
+                auto found = find_var(seg.name);
+                stats_.add(detail::stat_var_lookups);
+                stats_.add(detail::stat_var_hits, found.first ? 1 : 0);
+                record.add_var(found.first, found.second);
+            }
+        }
     }
 };
 
@@ -928,7 +3503,8 @@ public:
      */
     template<typename T>
     void set_var(const std::string& name, const T& value) {
-        set_var(name, to_string(value));
+        bool custom = has_formatter_impl(std::type_index(typeid(T)));
+        set_typed_var(name, to_string(value), custom ? detail::var_kind::string : detail::kind_of<T>());
     }
     
     /**
@@ -964,16 +3540,75 @@ public:
     bool has_formatter() const {
         return has_formatter_impl(std::type_index(typeid(T)));
     }
+    
+    /**
+     * @brief Format a message and emit it with all variables as a single-line JSON object
+     *
+     * Output is {"message":"<rendered message>","name":value,...}. Variables keep
+     * the type they were set from: integers, floating point values and booleans
+     * are written unquoted, everything else as JSON strings. A variable named
+     * "message" is omitted. The message and all variables are written in one pass
+     * straight into the sink (e.g. a reused std::string), without intermediate copies.
+     *
+     * @param sink Output sink (append(const char*, size_t)), not cleared
+     * @param template_str Message template
+     * @param args Message arguments
+     */
+    template<typename Sink, typename... Args>
+    void format_json_to(Sink& sink, const std::string& template_str, Args&&... args) {
+        sink.append("{\"message\":\"", 12);
+        detail::escaping_sink<Sink> message(sink, escape_mode::json);
+        format_impl_to(message, get_escape_mode(), template_str, std::forward<Args>(args)...);
+        sink.append("\"", 1);
+        visit_vars([&sink](const std::string& name, const detail::var_value& value) {
+            if (name == "message") {
+                return;
+            }
+            sink.append(",\"", 2);
+            detail::append_json_escaped(sink, name.data(), name.data() + name.size());
+            sink.append("\":", 2);
+            detail::append_json_value(sink, value);
+        });
+        sink.append("}", 1);
+    }
+    
+    /**
+     * @brief Format a message with all variables as a single-line JSON object
+     * @see format_json_to()
+     */
+    template<typename... Args>
+    std::string format_json(const std::string& template_str, Args&&... args) {
+        std::string result;
+        result.reserve(template_str.size() + 64);
+        format_json_to(result, template_str, std::forward<Args>(args)...);
+        return result;
+    }
 
 protected:
     /**
-     * @brief Check if current thread is the main thread
+     * @brief Store a variable together with the type it was converted from
+     *
+     * Default implementation drops the type and calls set_var().
+     */
+    virtual void set_typed_var(const std::string& name, const std::string& value, detail::var_kind kind) {
+        (void)kind;
+        set_var(name, value);
+    }
+    
+    /**
+     * @brief Call visitor for every visible variable (used by format_json_to())
+     *
+     * Default implementation visits nothing.
      */
-    bool is_main_thread() const {
-        ensure_main_thread_id_initialized();
-        return std::this_thread::get_id() == main_thread_id_;
+    virtual void visit_vars(const std::function<void(const std::string&, const detail::var_value&)>& visitor) const {
+        (void)visitor;
     }
     
+    /**
+     * @brief Check if current thread is the main thread
+     */
+    bool is_main_thread() const;
+    
     /**
      * @brief Set formatter implementation (type-erased)
      */
@@ -985,22 +3620,6 @@ protected:
     virtual void clear_formatter_impl(std::type_index type) = 0;
 
 private:
-    // Static members for main thread detection
-    static std::thread::id main_thread_id_;
-    static bool main_thread_id_initialized_;
-    
-    // Initialize main thread ID on first use
-    void ensure_main_thread_id_initialized() const {
-        static std::mutex init_mutex;
-        if (!main_thread_id_initialized_) {
-            std::lock_guard<std::mutex> lock(init_mutex);
-            if (!main_thread_id_initialized_) {
-                main_thread_id_ = std::this_thread::get_id();
-                main_thread_id_initialized_ = true;
-            }
-        }
-    }
-    
     // Helper function to convert values to string using formatters
     template<typename T>
     std::string to_string(const T& value) const {
@@ -1063,55 +3682,263 @@ protected:
  * This context is designed for single-thread use and provides fast
  * performance for local formatting operations with variable support and custom formatters.
  */
-class local_context : public context_base {
+class local_context : public context_base {
+private:
+    std::unordered_map<std::string, detail::var_value> variables_;
+    std::unordered_map<std::type_index, std::function<std::string(const void*)>> formatters_;
+    
+public:
+    local_context() = default;
+    ~local_context() = default;
+    
+    // Non-copyable, moveable
+    local_context(const local_context&) = delete;
+    local_context& operator=(const local_context&) = delete;
+    local_context(local_context&&) = default;
+    local_context& operator=(local_context&&) = default;
+    
+    // Bring template set_var into scope
+    using context_base::set_var;
+    
+    // Simple variable management (local storage only)
+    void set_var(const std::string& name, const std::string& value) override {
+        set_typed_var(name, value, detail::var_kind::string);
+    }
+    
+    void clear_var(const std::string& name) override {
+        variables_.erase(name);
+    }
+    
+    bool has_var(const std::string& name) const override {
+        return variables_.find(name) != variables_.end();
+    }
+
+protected:
+    std::string get_var(const std::string& name) const override {
+        auto it = variables_.find(name);
+        return (it != variables_.end()) ? it->second.text : std::string();
+    }
+    
+    void set_typed_var(const std::string& name, const std::string& value, detail::var_kind kind) override {
+        detail::var_value& stored = variables_[name];
+        stored.text = value;
+        stored.kind = kind;
+    }
+    
+    void visit_vars(const std::function<void(const std::string&, const detail::var_value&)>& visitor) const override {
+        for (const auto& var : variables_) {
+            visitor(var.first, var.second);
+        }
+    }
+    
+    void set_formatter_impl(std::type_index type, std::function<std::string(const void*)> formatter) override {
+        formatters_[type] = formatter;
+    }
+    
+    void clear_formatter_impl(std::type_index type) override {
+        formatters_.erase(type);
+    }
+    
+    bool has_formatter_impl(std::type_index type) const override {
+        return formatters_.find(type) != formatters_.end();
+    }
+    
+    std::string format_value_custom(std::type_index type, const void* value, const std::string& /* formatSpec */) const override {
+        auto it = formatters_.find(type);
+        if (it != formatters_.end()) {
+            return it->second(value);
+        }
+        return std::string();
+    }
+    
+    std::function<std::string(const void*)> get_formatter_impl(std::type_index type) const override {
+        auto it = formatters_.find(type);
+        return (it != formatters_.end()) ? it->second : std::function<std::string(const void*)>();
+    }
+    
+    void add_storage_stats(format_stats& stats) const override {
+        stats.var_bytes = detail::var_map_bytes(variables_);
+        stats.formatter_bytes = detail::hash_map_bytes(formatters_);
+    }
+};
+
+// ========== Arena Context (Single-Thread, Reusable) ==========
+
+/**
+ * @brief Reusable single-thread context with O(1) bulk reset of variables
+ * @ingroup contexts
+ *
+ * Behaves like local_context, but variables are kept in a flat, grow-only arena
+ * indexed by an open-addressing table. reset() drops all variables in O(1) by
+ * bumping a generation counter, while the arena keeps its capacity (including
+ * the capacity of the stored name/value strings). A single instance can thus be
+ * reused for every request handled by a worker thread without reallocating.
+ *
+ * Custom formatters are configuration, not per-request state, and survive reset().
+ *
+ * @code
+ * auto ctx = ufmt::create_arena_context();
+ * for (const auto& req : requests) {
+ *     ctx->reset();
+ *     ctx->set_var("path", req.path);
+ *     log(ctx->format("GET {path}"));
+ * }
+ * @endcode
+ */
+class arena_context : public context_base {
 private:
-    std::unordered_map<std::string, std::string> variables_;
+    struct var_entry {
+        std::string name;
+        detail::var_value value;
+        size_t hash;
+        bool live;
+    };
+
+    struct index_slot {
+        size_t generation;  ///< Slot is occupied only if equal to generation_
+        size_t entry;       ///< Index into entries_
+    };
+
+    std::vector<var_entry> entries_;   // Grow-only storage, first entry_count_ are in use
+    size_t entry_count_ = 0;
+    std::vector<index_slot> index_;    // Power-of-two sized open-addressing table
+    size_t generation_ = 1;
     std::unordered_map<std::type_index, std::function<std::string(const void*)>> formatters_;
-    
+
 public:
-    local_context() = default;
-    ~local_context() = default;
-    
+    arena_context() = default;
+    ~arena_context() = default;
+
+    /**
+     * @brief Create context with room for the given number of variables
+     * @param capacity Number of variables to reserve space for
+     */
+    explicit arena_context(size_t capacity) {
+        reserve(capacity);
+    }
+
     // Non-copyable, moveable
-    local_context(const local_context&) = delete;
-    local_context& operator=(const local_context&) = delete;
-    local_context(local_context&&) = default;
-    local_context& operator=(local_context&&) = default;
-    
+    arena_context(const arena_context&) = delete;
+    arena_context& operator=(const arena_context&) = delete;
+    arena_context(arena_context&&) = default;
+    arena_context& operator=(arena_context&&) = default;
+
     // Bring template set_var into scope
     using context_base::set_var;
-    
-    // Simple variable management (local storage only)
+
     void set_var(const std::string& name, const std::string& value) override {
-        variables_[name] = value;
+        set_typed_var(name, value, detail::var_kind::string);
     }
-    
+
     void clear_var(const std::string& name) override {
-        variables_.erase(name);
+        var_entry* entry = find_entry(name, std::hash<std::string>()(name));
+        if (entry) {
+            entry->live = false;
+            entry->value.text.clear();
+        }
     }
-    
+
     bool has_var(const std::string& name) const override {
-        return variables_.find(name) != variables_.end();
+        const var_entry* entry = find_entry(name, std::hash<std::string>()(name));
+        return entry && entry->live;
+    }
+
+    /**
+     * @brief Drop all variables in O(1), keeping allocated capacity
+     *
+     * Custom formatters are not affected.
+     */
+    void reset() {
+        ++generation_;
+        entry_count_ = 0;
+    }
+
+    /**
+     * @brief Reserve space for the given number of variables
+     * @param capacity Number of variables
+     */
+    void reserve(size_t capacity) {
+        entries_.reserve(capacity);
+        size_t wanted = 8;
+        while (wanted * 3 < capacity * 4) {
+            wanted *= 2;
+        }
+        if (wanted > index_.size()) {
+            rebuild_index(wanted);
+        }
+    }
+
+    /**
+     * @brief Number of variable slots allocated (retained across reset())
+     */
+    size_t capacity() const {
+        return entries_.capacity();
     }
 
 protected:
     std::string get_var(const std::string& name) const override {
-        auto it = variables_.find(name);
-        return (it != variables_.end()) ? it->second : std::string();
+        const var_entry* entry = find_entry(name, std::hash<std::string>()(name));
+        return (entry && entry->live) ? entry->value.text : std::string();
     }
-    
+
+    std::pair<bool, std::string> find_var(const std::string& name) const override {
+        const var_entry* entry = find_entry(name, std::hash<std::string>()(name));
+        if (entry && entry->live) {
+            return {true, entry->value.text};
+        }
+        return {false, std::string()};
+    }
+
+    void set_typed_var(const std::string& name, const std::string& value, detail::var_kind kind) override {
+        size_t hash = std::hash<std::string>()(name);
+        var_entry* entry = find_entry(name, hash);
+        if (entry) {
+            entry->value.text.assign(value);
+            entry->value.kind = kind;
+            entry->live = true;
+            return;
+        }
+
+        if ((entry_count_ + 1) * 4 > index_.size() * 3) {
+            grow_index();
+        }
+
+        if (entry_count_ == entries_.size()) {
+            entries_.push_back(var_entry{name, detail::var_value(value, kind), hash, true});
+        } else {
+            // Reuse a slot left over from a previous generation, keeping its capacity
+            var_entry& reused = entries_[entry_count_];
+            reused.name.assign(name);
+            reused.value.text.assign(value);
+            reused.value.kind = kind;
+            reused.hash = hash;
+            reused.live = true;
+        }
+        insert_index(hash, entry_count_);
+        ++entry_count_;
+    }
+
+    // Variables are visited in insertion order
+    void visit_vars(const std::function<void(const std::string&, const detail::var_value&)>& visitor) const override {
+        for (size_t i = 0; i < entry_count_; ++i) {
+            if (entries_[i].live) {
+                visitor(entries_[i].name, entries_[i].value);
+            }
+        }
+    }
+
     void set_formatter_impl(std::type_index type, std::function<std::string(const void*)> formatter) override {
         formatters_[type] = formatter;
     }
-    
+
     void clear_formatter_impl(std::type_index type) override {
         formatters_.erase(type);
     }
-    
+
     bool has_formatter_impl(std::type_index type) const override {
         return formatters_.find(type) != formatters_.end();
     }
-    
+
     std::string format_value_custom(std::type_index type, const void* value, const std::string& /* formatSpec */) const override {
         auto it = formatters_.find(type);
         if (it != formatters_.end()) {
@@ -1119,6 +3946,64 @@ protected:
         }
         return std::string();
     }
+
+    std::function<std::string(const void*)> get_formatter_impl(std::type_index type) const override {
+        auto it = formatters_.find(type);
+        return (it != formatters_.end()) ? it->second : std::function<std::string(const void*)>();
+    }
+
+    // Includes entries and string capacity retained across reset()
+    void add_storage_stats(format_stats& stats) const override {
+        stats.var_bytes = entries_.capacity() * sizeof(var_entry) + index_.capacity() * sizeof(index_slot);
+        for (const auto& entry : entries_) {
+            stats.var_bytes += detail::string_heap_bytes(entry.name) + detail::string_heap_bytes(entry.value.text);
+        }
+        stats.formatter_bytes = detail::hash_map_bytes(formatters_);
+    }
+
+private:
+    // Entry for name in the current generation (live or cleared), nullptr if absent
+    const var_entry* find_entry(const std::string& name, size_t hash) const {
+        if (index_.empty()) {
+            return nullptr;
+        }
+        size_t mask = index_.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            const index_slot& slot = index_[i];
+            if (slot.generation != generation_) {
+                return nullptr;
+            }
+            const var_entry& entry = entries_[slot.entry];
+            if (entry.hash == hash && entry.name == name) {
+                return &entry;
+            }
+        }
+    }
+
+    var_entry* find_entry(const std::string& name, size_t hash) {
+        return const_cast<var_entry*>(static_cast<const arena_context*>(this)->find_entry(name, hash));
+    }
+
+    void insert_index(size_t hash, size_t entry) {
+        size_t mask = index_.size() - 1;
+        size_t i = hash & mask;
+        while (index_[i].generation == generation_) {
+            i = (i + 1) & mask;
+        }
+        index_[i].generation = generation_;
+        index_[i].entry = entry;
+    }
+
+    void grow_index() {
+        rebuild_index(index_.empty() ? 8 : index_.size() * 2);
+    }
+
+    void rebuild_index(size_t size) {
+        index_.assign(size, index_slot{0, 0});
+        for (size_t i = 0; i < entry_count_; ++i) {
+            insert_index(entries_[i].hash, i);
+        }
+    }
 };
 
 // ========== Shared Context (Thread-Safe) ==========
@@ -1142,10 +4027,14 @@ protected:
  */
 class shared_context : public context_base {
 private:
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, std::string> variables_;
+    friend class context_manager;
+    
+    mutable detail::context_mutex mutex_;
+    std::unordered_map<std::string, detail::var_value> variables_;
     std::unordered_map<std::type_index, std::function<std::string(const void*)>> formatters_;
-    static thread_local std::unordered_map<std::string, std::string> thread_variables_;
+    
+    // Variables of the calling thread (shared by all shared_context instances)
+    static std::unordered_map<std::string, detail::var_value>& thread_variables();
     
 public:
     shared_context() = default;
@@ -1156,104 +4045,47 @@ public:
     
     // Transparent variable management
     void set_var(const std::string& name, const std::string& value) override {
-        if (is_main_thread()) {
-            // Main thread writes to shared storage
-            std::lock_guard<std::mutex> lock(mutex_);
-            variables_[name] = value;
-        } else {
-            // Worker threads write to thread-local storage
-            thread_variables_[name] = value;
-        }
+        set_typed_var(name, value, detail::var_kind::string);
     }
     
-    void clear_var(const std::string& name) override {
-        if (is_main_thread()) {
-            // Main thread clears from shared storage
-            std::lock_guard<std::mutex> lock(mutex_);
-            variables_.erase(name);
-        } else {
-            // Worker threads clear from thread-local storage
-            thread_variables_.erase(name);
-        }
-    }
+    void clear_var(const std::string& name) override;
     
-    bool has_var(const std::string& name) const override {
-        // Check thread-local first (no lock needed)
-        if (thread_variables_.find(name) != thread_variables_.end()) {
-            return true;
-        }
-        
-        // Check shared storage (lock needed)
-        std::lock_guard<std::mutex> lock(mutex_);
-        return variables_.find(name) != variables_.end();
+    bool has_var(const std::string& name) const override;
+    
+    /**
+     * @brief Usage of this context's mutex (empty unless UFMT_ENABLE_LOCK_STATS is defined)
+     */
+    mutex_stats lock_stats() const {
+        return detail::stats_of(mutex_);
     }
 
 protected:
-    std::string get_var(const std::string& name) const override {
-        // Check thread-local variables first (no lock needed)
-        auto thread_it = thread_variables_.find(name);
-        if (thread_it != thread_variables_.end()) {
-            return thread_it->second;
-        }
-        
-        // Fall back to shared variables (lock needed)
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = variables_.find(name);
-        return (it != variables_.end()) ? it->second : std::string();
-    }
+    std::string get_var(const std::string& name) const override;
+    
+    void set_typed_var(const std::string& name, const std::string& value, detail::var_kind kind) override;
+    
+    // Thread-local variables first, then shared ones they do not override
+    void visit_vars(const std::function<void(const std::string&, const detail::var_value&)>& visitor) const override;
     
     // Optimized: find variable and retrieve value in a single lock (for shared variables)
-    bool find_var(const std::string& name, std::string& value) const {
-        // Check thread-local variables first (no lock needed)
-        auto thread_it = thread_variables_.find(name);
-        if (thread_it != thread_variables_.end()) {
-            value = thread_it->second;
-            return true;
-        }
-        // Fall back to shared variables (lock needed)
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = variables_.find(name);
-        if (it != variables_.end()) {
-            value = it->second;
-            return true;
-        }
-        value.clear();
-        return false;
-    }
+    bool find_var(const std::string& name, std::string& value) const;
     
-    void set_formatter_impl(std::type_index type, std::function<std::string(const void*)> formatter) override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        formatters_[type] = formatter;
-    }
+    void set_formatter_impl(std::type_index type, std::function<std::string(const void*)> formatter) override;
     
-    void clear_formatter_impl(std::type_index type) override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        formatters_.erase(type);
-    }
+    void clear_formatter_impl(std::type_index type) override;
     
-    bool has_formatter_impl(std::type_index type) const override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return formatters_.find(type) != formatters_.end();
-    }
+    bool has_formatter_impl(std::type_index type) const override;
     
-    std::string format_value_custom(std::type_index type, const void* value, const std::string& /* formatSpec */) const override {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = formatters_.find(type);
-        if (it != formatters_.end()) {
-            return it->second(value);
-        }
-        return std::string();
-    }
+    std::string format_value_custom(std::type_index type, const void* value, const std::string& /* formatSpec */) const override;
+    
+    std::function<std::string(const void*)> get_formatter_impl(std::type_index type) const override;
+    
+    // Shared storage only; thread-local variables belong to the threads
+    void add_storage_stats(format_stats& stats) const override;
     
 protected:
     // Override find_var for optimized single-lock access
-    std::pair<bool, std::string> find_var(const std::string& name) const override {
-        std::string value;
-        if (find_var(name, value)) {
-            return {true, value};
-        }
-        return {false, std::string()};
-    }
+    std::pair<bool, std::string> find_var(const std::string& name) const override;
 };
 
 // ========== Context Manager (Thread-Safe) ==========
@@ -1271,8 +4103,16 @@ protected:
  */
 class context_manager {
 private:
-    static std::mutex contexts_mutex_;
-    static std::unordered_map<std::string, std::shared_ptr<shared_context>> contexts_;
+    struct registry {
+        detail::context_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<shared_context>> contexts;
+        
+        registry() {
+            detail::set_mutex_name(mutex, "context_manager");
+        }
+    };
+    
+    static registry& contexts();
     
 public:
     /**
@@ -1280,42 +4120,187 @@ public:
      * @param name Context name
      * @return Shared pointer to the context
      */
-    static std::shared_ptr<shared_context> get_context(const std::string& name) {
-        std::lock_guard<std::mutex> lock(contexts_mutex_);
-        auto it = contexts_.find(name);
-        if (it == contexts_.end()) {
-            auto ctx = std::make_shared<shared_context>();
-            contexts_[name] = ctx;
-            return ctx;
-        }
-        return it->second;
-    }
+    static std::shared_ptr<shared_context> get_context(const std::string& name);
     
     /**
      * @brief Remove a named context
      * @param name Context name to remove
      */
-    static void remove_context(const std::string& name) {
-        std::lock_guard<std::mutex> lock(contexts_mutex_);
-        contexts_.erase(name);
-    }
+    static void remove_context(const std::string& name);
     
     /**
      * @brief Clear all named contexts
      */
-    static void clear_all_contexts() {
-        std::lock_guard<std::mutex> lock(contexts_mutex_);
-        contexts_.clear();
-    }
+    static void clear_all_contexts();
 };
 
-// Static member definitions
-std::mutex context_manager::contexts_mutex_;
-std::unordered_map<std::string, std::shared_ptr<shared_context>> context_manager::contexts_;
+// ========== Batch Formatting ==========
+
+namespace detail {
+
+/**
+ * @brief Per-call execution plan for format_batch()
+ *
+ * Built once per batch: literal runs (including resolved named variables) are
+ * merged into one string, and every positional placeholder gets a function
+ * pointer specialized for the field type and for the chosen path (default,
+ * format spec or custom formatter). Custom formatters are copied out of the
+ * context, so a finished plan is self-contained and each thread can use its
+ * own copy.
+ */
+template<typename Row, typename Sink>
+class batch_plan {
+public:
+    batch_plan(format_context_base& ctx, const compiled_template& tmpl) : stats_(&ctx.stats_) {
+        build(ctx, tmpl);
+    }
+
+    void write(const Row& row, Sink& sink) const {
+        for (const auto& st : steps_) {
+            if (st.fn) {
+                st.fn(*this, st, row, sink);
+            } else {
+                sink.append(literals_.data() + st.offset, st.length);
+            }
+        }
+    }
+
+    /**
+     * @brief Write the rows of [first, last), terminating each one
+     */
+    template<typename Iterator>
+    void write_rows(Iterator first, Iterator last, Sink& sink) const {
+        if (first == last) {
+            return;
+        }
+        size_t count = static_cast<size_t>(std::distance(first, last));
+        stats_->add(stat_batch_rows, count);
+        size_t before = batch_bytes(sink);
+        write(*first, sink);
+        end_batch_row(sink);
+        size_t row_bytes = batch_bytes(sink) - before;
+        reserve_batch(sink, count - 1, (count - 1) * row_bytes + row_bytes / 8 * count);
+        for (++first; first != last; ++first) {
+            write(*first, sink);
+            end_batch_row(sink);
+        }
+    }
+
+private:
+    struct step;
+    typedef void (*field_fn)(const batch_plan& plan, const step& st, const Row& row, Sink& sink);
+
+    struct step {
+        field_fn fn;               // nullptr for literal runs
+        size_t offset;             // Literal run in literals_, or custom formatter index
+        size_t length;
+        const FormatSpec* spec;    // Parsed format spec of a field placeholder
+        escape_mode escape;        // Escaping of the field value
+    };
+
+    // Writers per path; [1] variants escape the value
+    enum field_path { path_plain, path_spec, path_custom };
+
+    struct field_info {
+        field_fn writers[3][2];
+        const std::type_info* type;
+    };
+
+    static const size_t field_count = row_traits<Row>::size;
+
+    std::string literals_;
+    std::vector<step> steps_;
+    // Copies taken from the context, so a plan can be used without it
+    std::vector<std::function<std::string(const void*)>> formatters_;
+    const stat_counters* stats_;  // Counters of the context (no-op without UFMT_ENABLE_STATS)
+
+    void build(format_context_base& ctx, const compiled_template& tmpl) {
+        const field_info* fields = field_table(typename make_index_sequence<field_count>::type());
+        const std::string& source = tmpl.source();
+        size_t literal_begin = 0;
+        for (const auto& seg : tmpl.segments()) {
+            if (seg.kind == compiled_template::segment_kind::positional && seg.index < field_count) {
+                flush_literal(literal_begin);
+                const field_info& info = fields[seg.index];
+                escape_mode escape = seg.has_escape ? seg.escape : ctx.default_escape_;
+                step st{nullptr, 0, 0, &seg.format, escape};
+                field_path path = seg.has_spec ? path_spec : path_plain;
+                std::function<std::string(const void*)> formatter = ctx.get_formatter_impl(std::type_index(*info.type));
+                if (formatter) {
+                    path = path_custom;
+                    st.offset = formatters_.size();
+                    formatters_.push_back(std::move(formatter));
+                }
+                st.fn = info.writers[path][escape == escape_mode::none ? 0 : 1];
+                steps_.push_back(st);
+            } else if (seg.kind == compiled_template::segment_kind::named) {
+                auto found = ctx.find_var(seg.name);
+                stats_->add(stat_var_lookups);
+                stats_->add(stat_var_hits, found.first ? 1 : 0);
+                if (found.first) {
+                    std::string value = seg.spec.empty() ? found.second : apply_format(found.second, seg.format);
+                    append_escaped(literals_, value.data(), value.length(), seg.has_escape ? seg.escape : ctx.default_escape_);
+                } else {
+                    literals_.append(source, seg.offset, seg.length);
+                }
+            } else {
+                // Literal text or a placeholder without a matching field
+                literals_.append(source, seg.offset, seg.length);
+            }
+        }
+        flush_literal(literal_begin);
+    }
+
+    void flush_literal(size_t& begin) {
+        if (literals_.size() > begin) {
+            steps_.push_back(step{nullptr, begin, literals_.size() - begin, nullptr, escape_mode::none});
+            begin = literals_.size();
+        }
+    }
+
+    template<size_t... I>
+    static const field_info* field_table(index_sequence<I...>) {
+        static const field_info table[] = {
+            field_info{{{&write_plain<I, Sink>, &write_escaped<I, path_plain>},
+                        {&write_spec<I, Sink>, &write_escaped<I, path_spec>},
+                        {&write_custom<I, Sink>, &write_escaped<I, path_custom>}},
+                       &typeid(typename row_traits<Row>::template field_type<I>)}...,
+            field_info{{{nullptr, nullptr}, {nullptr, nullptr}, {nullptr, nullptr}}, nullptr}
+        };
+        return table;
+    }
+
+    template<size_t I, typename Out>
+    static void write_plain(const batch_plan& /* plan */, const step& /* st */, const Row& row, Out& sink) {
+        append_default(sink, row_traits<Row>::template get<I>(row));
+    }
+
+    template<size_t I, typename Out>
+    static void write_spec(const batch_plan& /* plan */, const step& st, const Row& row, Out& sink) {
+        append_formatted(sink, row_traits<Row>::template get<I>(row), *st.spec);
+    }
+
+    template<size_t I, typename Out>
+    static void write_custom(const batch_plan& plan, const step& st, const Row& row, Out& sink) {
+        typedef typename row_traits<Row>::template field_type<I> field_type;
+        const field_type& value = row_traits<Row>::template get<I>(row);
+        plan.stats_->add(stat_custom_formats);
+        std::string text = plan.formatters_[st.offset](&value);
+        sink.append(text.data(), text.length());
+    }
+
+    template<size_t I, int Path>
+    static void write_escaped(const batch_plan& plan, const step& st, const Row& row, Sink& sink) {
+        escaping_sink<Sink> escaped(sink, st.escape);
+        switch (Path) {
+        case path_plain: write_plain<I>(plan, st, row, escaped); break;
+        case path_spec: write_spec<I>(plan, st, row, escaped); break;
+        default: write_custom<I>(plan, st, row, escaped); break;
+        }
+    }
+};
 
-// Context base static members
-std::thread::id context_base::main_thread_id_;
-bool context_base::main_thread_id_initialized_ = false;
+} // namespace detail
 
 // ========== Public API Functions ==========
 
@@ -1350,7 +4335,96 @@ inline internal_context& get_singleton_internal_context() {
  */
 template<typename... Args>
 std::string format(const std::string& template_str, Args&&... args) {
-    return detail::get_singleton_internal_context().format(template_str, std::forward<Args>(args)...);
+    return detail::get_singleton_internal_context().vformat(template_str, make_format_args(args...));
+}
+
+/**
+ * @brief Format and append the result to a sink (using internal singleton context)
+ * @ingroup core
+ * @param sink Any object providing append(const char*, size_t), e.g. std::string or fd_sink
+ * @param template_str Template string with {0}, {1}, etc. placeholders
+ * @param args Arguments to substitute
+ */
+template<typename Sink, typename... Args>
+void format_to(Sink& sink, const std::string& template_str, Args&&... args) {
+    detail::get_singleton_internal_context().vformat_to(sink, template_str, make_format_args(args...));
+}
+
+/**
+ * @brief Format with arguments packed by make_format_args() (using internal singleton context)
+ * @ingroup core
+ *
+ * Non-template entry point behind format(); useful for wrappers that take
+ * their own variadic arguments and forward them without instantiating the
+ * formatter for every argument combination.
+ *
+ * Example:
+ *   template<typename... Args>
+ *   void log_info(const std::string& tmpl, const Args&... args) {
+ *       write_log(ufmt::vformat(tmpl, ufmt::make_format_args(args...)));
+ *   }
+ */
+inline std::string vformat(const std::string& template_str, format_args args) {
+    return detail::get_singleton_internal_context().vformat(template_str, args);
+}
+
+/**
+ * @brief Format with packed arguments and append the result to a sink (using internal singleton context)
+ * @ingroup core
+ */
+template<typename Sink>
+void vformat_to(Sink& sink, const std::string& template_str, format_args args) {
+    detail::get_singleton_internal_context().vformat_to(sink, template_str, args);
+}
+
+/**
+ * @brief Format one template over many rows (using internal singleton context)
+ * @ingroup core
+ * @param tmpl Compiled template or template string; {i} refers to field i of a row
+ * @param rows Range of std::tuple / std::pair rows, or a ufmt::columns() set
+ * @param sink Any sink; batch_output additionally records per-row offsets
+ *
+ * Example:
+ *   std::vector<std::tuple<std::string, int, double>> rows = ...;
+ *   ufmt::batch_output out;
+ *   ufmt::format_batch(*ufmt::compile("{0};{1};{2:.2f}\n"), rows, out);
+ *   // out.buffer() holds all rows, out.row(i) a single one
+ */
+template<typename Rows, typename Sink>
+void format_batch(const compiled_template& tmpl, const Rows& rows, Sink& sink) {
+    detail::get_singleton_internal_context().format_batch(tmpl, rows, sink);
+}
+
+template<typename Rows, typename Sink>
+void format_batch(const std::string& template_str, const Rows& rows, Sink& sink) {
+    detail::get_singleton_internal_context().format_batch(template_str, rows, sink);
+}
+
+/**
+ * @brief Capture arguments for deferred formatting (using internal singleton context)
+ * @ingroup core
+ * @param tmpl Compiled template (reference, shared pointer) or template string
+ * @param args Arguments to capture
+ * @return Self-contained record that can be formatted later on any thread
+ *
+ * Example:
+ *   static const auto tmpl = ufmt::compile("Fill {0} @ {1:.2f}");
+ *   auto rec = ufmt::capture(*tmpl, id, price);  // cheap, no formatting
+ *   rec.format_to(out);                          // later, e.g. on a logging thread
+ */
+template<typename... Args>
+format_record capture(const compiled_template& tmpl, Args&&... args) {
+    return detail::get_singleton_internal_context().capture(tmpl, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+format_record capture(const std::shared_ptr<const compiled_template>& tmpl, Args&&... args) {
+    return detail::get_singleton_internal_context().capture(tmpl, std::forward<Args>(args)...);
+}
+
+template<typename... Args>
+format_record capture(const std::string& template_str, Args&&... args) {
+    return detail::get_singleton_internal_context().capture(template_str, std::forward<Args>(args)...);
 }
 
 /**
@@ -1362,6 +4436,16 @@ inline std::unique_ptr<local_context> create_local_context() {
     return std::unique_ptr<local_context>(new local_context());
 }
 
+/**
+ * @brief Create a new arena context (single-thread, reusable via reset())
+ * @ingroup core
+ * @param capacity Number of variables to reserve space for
+ * @return Unique pointer to arena context
+ */
+inline std::unique_ptr<arena_context> create_arena_context(size_t capacity = 0) {
+    return std::unique_ptr<arena_context>(new arena_context(capacity));
+}
+
 /**
  * @brief Create a new shared context (thread-safe, owning smart pointer)
  * @ingroup core
@@ -1381,13 +4465,32 @@ inline std::shared_ptr<shared_context> get_shared_context(const std::string& nam
     return context_manager::get_context(name);
 }
 
-// ========== Thread-local Storage Definitions ==========
+// ========== Separate Compilation ==========
 
-/**
- * @brief Thread-local storage for shared_context variables
- */
-thread_local std::unordered_map<std::string, std::string> shared_context::thread_variables_;
+#if defined(UFMT_SEPARATE_COMPILATION) && !defined(UFMT_SOURCE)
+// Kernels for std::string output are instantiated once in the library
+namespace detail {
+extern template void append_aligned<std::string>(std::string&, const char*, size_t, const FormatSpec&);
+extern template void append_double<std::string>(std::string&, double, const FormatSpec&);
+extern template void append_integer<std::string>(std::string&, unsigned long long, bool, const FormatSpec&);
+extern template void append_text_formatted<std::string>(std::string&, const char*, size_t, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const std::string&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const char* const&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const bool&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const char&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const double&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const long long&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const int&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const unsigned long long&, const FormatSpec&);
+extern template void append_formatted<std::string>(std::string&, const unsigned int&, const FormatSpec&);
+extern template void append_escaped<std::string>(std::string&, const char*, size_t, escape_mode);
+} // namespace detail
+#endif
 
 } // namespace ufmt
 
+#if !defined(UFMT_SEPARATE_COMPILATION)
+#include "ufmt_impl.h"
+#endif
+
 #endif // __UFMT_H__
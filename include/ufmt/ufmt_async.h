@@ -0,0 +1,393 @@
+/**
+ * @file ufmt_async.h
+ * @brief Asynchronous logging backend for ufmt
+ *
+ * Producers capture format records (see ufmt::format_record) and push them into a
+ * bounded lock-free multi-producer ring buffer. A dedicated consumer thread formats
+ * the records and writes the output to a file descriptor in batches.
+ *
+ * Usage:
+ * @code
+ * #include "ufmt/ufmt_async.h"
+ *
+ * ufmt::async_logger logger(STDOUT_FILENO);
+ * static const auto tmpl = ufmt::compile("[{level}] order {0} filled at {1:.2f}");
+ *
+ * auto ctx = ufmt::get_shared_context("app");
+ * ctx->set_var("level", "INFO");
+ * logger.log(*ctx, *tmpl, order_id, price);   // variables snapshotted here
+ * logger.flush();                             // wait until written
+ * @endcode
+ *
+ * @author Piotr Likus
+ * License: MIT
+ * @version 1.0
+ * @date 2025
+ */
+
+#ifndef __UFMT_ASYNC_H__
+#define __UFMT_ASYNC_H__
+
+#include "ufmt.h"
+#include "ufmt_io.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+namespace ufmt {
+
+namespace detail {
+
+/**
+ * @brief Bounded lock-free multi-producer ring buffer (single consumer)
+ *
+ * Each cell carries a sequence number telling whether it is free for the
+ * producer of a given ticket or ready for the consumer, so producers only
+ * contend on a single compare-and-swap of the enqueue position.
+ */
+template<typename T>
+class mpsc_ring {
+public:
+    explicit mpsc_ring(size_t capacity)
+        : mask_(round_up(capacity) - 1), cells_(new cell[mask_ + 1]), enqueue_pos_(0), dequeue_pos_(0) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpsc_ring(const mpsc_ring&) = delete;
+    mpsc_ring& operator=(const mpsc_ring&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    /**
+     * @brief Try to enqueue a value (any thread)
+     * @return false if the ring is full; value is left untouched in that case
+     */
+    bool try_push(T& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        cell* target;
+        for (;;) {
+            target = &cells_[pos & mask_];
+            size_t seq = target->sequence.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (seq < pos) {
+                return false;  // Cell still holds a value from the previous lap
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        target->value = std::move(value);
+        target->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Check if a value is ready to be dequeued (consumer thread only)
+     */
+    bool has_data() const {
+        return cells_[dequeue_pos_ & mask_].sequence.load(std::memory_order_acquire) == dequeue_pos_ + 1;
+    }
+
+    /**
+     * @brief Try to dequeue a value (consumer thread only)
+     * @return false if the ring is empty
+     */
+    bool try_pop(T& value) {
+        cell& source = cells_[dequeue_pos_ & mask_];
+        size_t seq = source.sequence.load(std::memory_order_acquire);
+        if (seq != dequeue_pos_ + 1) {
+            return false;
+        }
+        value = std::move(source.value);
+        source.sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // Producers and the consumer each write a cache line of their own
+    const size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) size_t dequeue_pos_;
+};
+
+} // namespace detail
+
+/**
+ * @brief What async_logger::log() does when the ring buffer is full
+ * @ingroup core
+ */
+enum class overflow_policy {
+    block,          ///< Wait (yielding) until the consumer frees a slot
+    drop,           ///< Discard the record silently
+    drop_and_count  ///< Discard the record and count it, see async_logger::dropped_count()
+};
+
+/**
+ * @brief Asynchronous logger formatting deferred records on a dedicated thread
+ * @ingroup core
+ *
+ * log() captures its arguments into a format_record (named variables and custom
+ * formatters of the given context are snapshotted at that point) and pushes it
+ * into a bounded lock-free ring buffer. The consumer thread formats records
+ * straight into an fd_sink, which writes them with writev when the batch is full
+ * or the ring runs empty. Each record is terminated with a newline.
+ *
+ * The logger does not own the file descriptor. Pending records are written
+ * when the logger is destroyed.
+ */
+class async_logger {
+public:
+    /**
+     * @brief Start a logger writing to a file descriptor
+     * @param fd Destination file descriptor (not closed by the logger)
+     * @param capacity Ring buffer capacity in records (rounded up to a power of two)
+     * @param policy Behaviour when the ring buffer is full
+     * @param batch_bytes Output batch size triggering a write
+     */
+    explicit async_logger(int fd, size_t capacity = 8192,
+                          overflow_policy policy = overflow_policy::block,
+                          size_t batch_bytes = 64 * 1024)
+        : policy_(policy), ring_(capacity), sink_(fd, batch_bytes),
+          running_(true), consumer_waiting_(false), in_flight_(0), enqueued_(0), written_(0), dropped_(0), write_errors_(0) {
+        consumer_ = std::thread(&async_logger::consume, this);
+    }
+
+    ~async_logger() {
+        stop();
+    }
+
+    async_logger(const async_logger&) = delete;
+    async_logger& operator=(const async_logger&) = delete;
+
+    /**
+     * @brief Log using the internal context (no variables or custom formatters)
+     * @param tmpl Compiled template (reference must outlive the record, or shared pointer) or template string
+     * @return false if the record was dropped
+     */
+    template<typename... Args>
+    bool log(const compiled_template& tmpl, Args&&... args) {
+        return push(ufmt::capture(tmpl, std::forward<Args>(args)...));
+    }
+
+    template<typename... Args>
+    bool log(const std::shared_ptr<const compiled_template>& tmpl, Args&&... args) {
+        return push(ufmt::capture(tmpl, std::forward<Args>(args)...));
+    }
+
+    template<typename... Args>
+    bool log(const std::string& template_str, Args&&... args) {
+        return push(ufmt::capture(template_str, std::forward<Args>(args)...));
+    }
+
+    /**
+     * @brief Log using a context; its variables and formatters are resolved now
+     * @param ctx Local, arena or shared context
+     * @param tmpl Compiled template (reference, shared pointer) or template string
+     * @return false if the record was dropped
+     */
+    template<typename Tmpl, typename... Args>
+    bool log(format_context_base& ctx, const Tmpl& tmpl, Args&&... args) {
+        return push(ctx.capture(tmpl, std::forward<Args>(args)...));
+    }
+
+    /**
+     * @brief Enqueue an already captured record
+     * @return false if the record was dropped
+     */
+    bool push(format_record&& record) {
+        // Counted before running_ is read, so the final drain waits for this push (see consume())
+        in_flight_.fetch_add(1);
+        bool pushed = false;
+        if (running_.load()) {
+            pushed = enqueue(record);
+        } else {
+            count_drop();
+        }
+        in_flight_.fetch_sub(1, std::memory_order_release);
+        return pushed;
+    }
+
+    /**
+     * @brief Wait until all records enqueued so far have been written
+     */
+    void flush() {
+        unsigned long long target = enqueued_.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(mutex_);
+        flush_requested_ = true;
+        wake_cv_.notify_one();
+        done_cv_.wait(lock, [this, target]() {
+            return written_.load(std::memory_order_acquire) >= target || !running_.load();
+        });
+    }
+
+    /**
+     * @brief Drain pending records, write them and stop the consumer thread
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_.load()) {
+                return;
+            }
+            running_.store(false);
+            wake_cv_.notify_one();
+        }
+        if (consumer_.joinable()) {
+            consumer_.join();
+        }
+    }
+
+    /**
+     * @brief Number of records discarded under overflow_policy::drop_and_count
+     */
+    unsigned long long dropped_count() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of records formatted and written so far
+     */
+    unsigned long long written_count() const {
+        return written_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Number of failed write calls on the file descriptor
+     */
+    unsigned long long write_error_count() const {
+        return write_errors_.load(std::memory_order_relaxed);
+    }
+
+private:
+    overflow_policy policy_;
+    detail::mpsc_ring<format_record> ring_;
+    fd_sink sink_;  // Consumer thread only
+    std::thread consumer_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    bool flush_requested_ = false;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> consumer_waiting_;
+    std::atomic<unsigned> in_flight_;  // push() calls between their running_ check and return
+    std::atomic<unsigned long long> enqueued_;
+    std::atomic<unsigned long long> written_;
+    std::atomic<unsigned long long> dropped_;
+    std::atomic<unsigned long long> write_errors_;
+
+    void count_drop() {
+        if (policy_ == overflow_policy::drop_and_count) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool enqueue(format_record& record) {
+        if (!ring_.try_push(record)) {
+            if (policy_ != overflow_policy::block) {
+                count_drop();
+                return false;
+            }
+            do {
+                wake_consumer();
+                std::this_thread::yield();
+            } while (!ring_.try_push(record));
+        }
+        enqueued_.fetch_add(1, std::memory_order_release);
+        // Pairs with the fence in consume(): either the consumer sees the record
+        // before it sleeps, or this thread sees it waiting and wakes it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting_.load(std::memory_order_relaxed)) {
+            wake_consumer();
+        }
+        return true;
+    }
+
+    void wake_consumer() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_cv_.notify_one();
+    }
+
+    void write_batch(unsigned long long& pending) {
+        sink_.flush();
+        write_errors_.store(sink_.stats().write_errors, std::memory_order_relaxed);
+        if (pending > 0) {
+            written_.fetch_add(pending, std::memory_order_release);
+            pending = 0;
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_cv_.notify_all();
+        }
+    }
+
+    void drain(format_record& record, unsigned long long& pending) {
+        while (ring_.try_pop(record)) {
+            record.format_to(sink_);
+            sink_.push_back('\n');
+            record = format_record();
+            ++pending;
+        }
+    }
+
+    void consume() {
+        format_record record;
+        unsigned long long pending = 0;
+        for (;;) {
+            drain(record, pending);
+            write_batch(pending);
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!running_.load()) {
+                lock.unlock();
+                // Producers that read running_ before the stop may still be pushing;
+                // once none is in flight, one more drain collects everything they pushed
+                for (;;) {
+                    bool idle = in_flight_.load() == 0;
+                    drain(record, pending);
+                    if (idle) {
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+                write_batch(pending);
+                std::lock_guard<std::mutex> done_lock(mutex_);
+                done_cv_.notify_all();
+                return;
+            }
+            // Producers notify only while we are waiting. The fence pairs with the
+            // one in enqueue(), so a record pushed before they read this flag is
+            // seen by has_data() below and no wake-up is lost.
+            consumer_waiting_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wake_cv_.wait(lock, [this]() {
+                return flush_requested_ || !running_.load() || ring_.has_data();
+            });
+            flush_requested_ = false;
+            consumer_waiting_.store(false, std::memory_order_relaxed);
+        }
+    }
+};
+
+} // namespace ufmt
+
+#endif // __UFMT_ASYNC_H__
@@ -0,0 +1,967 @@
+/**
+ * @file ufmt_impl.h
+ * @brief Definitions of the non-template parts of ufmt
+ *
+ * Included at the end of ufmt.h in the default header-only mode, where every
+ * function is inline. With UFMT_SEPARATE_COMPILATION defined, ufmt.h only
+ * declares these functions and this file is compiled once, by src/ufmt.cpp
+ * (CMake target ufmt_static), which also instantiates the formatting kernels
+ * for std::string output.
+ *
+ * Usage (separate compilation):
+ * @code
+ * // Every translation unit, e.g. via target_link_libraries(app ufmt_static)
+ * #define UFMT_SEPARATE_COMPILATION
+ * #include "ufmt/ufmt.h"
+ * @endcode
+ *
+ * @author Piotr Likus
+ * License: MIT
+ * @version 1.0
+ * @date 2025
+ */
+
+#ifndef __UFMT_IMPL_H__
+#define __UFMT_IMPL_H__
+
+#include "ufmt.h"
+
+#include <thread>
+
+namespace ufmt {
+
+namespace detail {
+
+// ========== Text Width ==========
+
+UFMT_DECL size_t text_width(const char* data, size_t size, width_mode mode) {
+    if (mode == width_mode::bytes) {
+        return size;
+    }
+    size_t i = ascii_prefix_length(data, size);
+    size_t width = i;
+    const char* end = data + size;
+    while (i < size) {
+        if (static_cast<unsigned char>(data[i]) < 0x80) {
+            ++width;
+            ++i;
+            continue;
+        }
+        uint32_t cp;
+        i += decode_utf8(data + i, end, cp);
+        width += mode == width_mode::columns ? codepoint_columns(cp) : 1;
+    }
+    return width;
+}
+
+UFMT_DECL size_t text_prefix(const char* data, size_t size, size_t max_width, width_mode mode, size_t& prefix_width) {
+    if (mode == width_mode::bytes) {
+        prefix_width = std::min(size, max_width);
+        return prefix_width;
+    }
+    size_t i = ascii_prefix_length(data, std::min(size, max_width));
+    size_t width = i;
+    const char* end = data + size;
+    while (i < size) {
+        size_t length = 1;
+        size_t columns = 1;
+        if (static_cast<unsigned char>(data[i]) >= 0x80) {
+            uint32_t cp;
+            length = decode_utf8(data + i, end, cp);
+            columns = mode == width_mode::columns ? codepoint_columns(cp) : 1;
+        }
+        if (width + columns > max_width) {
+            break;
+        }
+        width += columns;
+        i += length;
+    }
+    prefix_width = width;
+    return i;
+}
+
+// ========== Format Specifications ==========
+
+UFMT_DECL FormatSpec parse_format_spec(const char* spec, size_t length) {
+    FormatSpec out;
+    out.format_string.assign(spec, length);
+    const char* p = spec;
+    const char* end = spec + length;
+    if (end - p >= 2 && is_align_char(p[1]) && p[0] != '{' && p[0] != '}') {
+        out.fill = *p++;
+    }
+    if (p < end && is_align_char(*p)) {
+        out.align = *p == '-' ? '<' : *p;
+        ++p;
+    }
+    out.left_justify = out.align == '<';
+    if (p < end && (*p == '+' || *p == ' ')) {
+        out.sign = *p++;
+    }
+    if (p < end && (*p == 'U' || *p == 'W')) {
+        out.width_unit = *p++ == 'U' ? width_mode::codepoints : width_mode::columns;
+    }
+    if (p < end && *p == '#') {
+        out.alternate = true;
+        ++p;
+    }
+    if (p < end && *p == '0') {
+        out.zero_pad = true;
+        ++p;
+    }
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        out.width = out.width * 10 + (*p - '0');
+    }
+    if (p < end && (*p == ',' || *p == '_')) {
+        out.grouping = *p++;
+    }
+    if (p < end && *p == '.') {
+        out.precision = 0;
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            out.precision = out.precision * 10 + (*p - '0');
+        }
+    }
+    while (p < end && std::strchr("hlLqjzt", *p) != nullptr) {
+        ++p;
+    }
+    if (p < end) {
+        out.format_type = *p;
+    }
+    return out;
+}
+
+UFMT_DECL std::string format_double_value(double value, const std::string& formatSpec) {
+    return format_value(value, parse_format_spec(formatSpec));
+}
+
+UFMT_DECL std::string format_integer_value(long long value, const std::string& formatSpec) {
+    return format_value(value, parse_format_spec(formatSpec));
+}
+
+UFMT_DECL std::string apply_string_formatting(const std::string& value, const std::string& formatSpec) {
+    if (formatSpec.empty()) {
+        return value;
+    }
+    std::string result;
+    append_aligned(result, value.data(), value.length(), parse_format_spec(formatSpec));
+    return result;
+}
+
+UFMT_DECL std::string apply_format(const std::string& value, const FormatSpec& spec) {
+    std::string result;
+    append_text_formatted(result, value.data(), value.length(), spec);
+    return result;
+}
+
+UFMT_DECL std::string apply_format(const std::string& value, const std::string& formatSpec) {
+    if (formatSpec.empty()) {
+        return value;
+    }
+    return apply_format(value, parse_format_spec(formatSpec));
+}
+
+// ========== Template Scanning ==========
+
+#ifdef UFMT_SIMD_AVX2
+UFMT_DECL bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;  // OS does not save YMM registers
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+UFMT_DECL find_brace_fn select_find_brace() {
+#if defined(UFMT_SIMD_AVX2)
+    if (cpu_has_avx2()) {
+        return &find_brace_avx2;
+    }
+#endif
+#if defined(UFMT_SIMD_SSE2)
+    return &find_brace_sse2;
+#elif defined(UFMT_SIMD_NEON)
+    return &find_brace_neon;
+#else
+    return &find_brace_scalar;
+#endif
+}
+
+UFMT_DECL bool parse_escape_mode(const char* name, size_t length, escape_mode& mode) {
+    struct entry { const char* name; size_t length; escape_mode mode; };
+    static const entry modes[] = {
+        {"json", 4, escape_mode::json}, {"html", 4, escape_mode::html},
+        {"csv", 3, escape_mode::csv}, {"raw", 3, escape_mode::none}
+    };
+    for (const auto& m : modes) {
+        if (m.length == length && std::memcmp(m.name, name, length) == 0) {
+            mode = m.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+UFMT_DECL bool parse_placeholder(const char* begin, const char* end, placeholder_ref& ph) {
+    if (begin == end) {
+        return false;  // "{}" is literal
+    }
+    const char* colon = static_cast<const char*>(std::memchr(begin, ':', static_cast<size_t>(end - begin)));
+    const char* name_end = colon ? colon : end;
+    ph.has_spec = colon != nullptr;
+    ph.spec = colon ? colon + 1 : end;
+    ph.spec_length = static_cast<size_t>(end - ph.spec);
+    ph.index = 0;
+    ph.escape = escape_mode::none;
+    ph.has_escape = false;
+    const char* bang = static_cast<const char*>(std::memchr(begin, '!', static_cast<size_t>(name_end - begin)));
+    if (bang) {
+        const char* modifier = bang + 1;
+        if (bang == begin || !parse_escape_mode(modifier, static_cast<size_t>(name_end - modifier), ph.escape)) {
+            return false;
+        }
+        ph.has_escape = true;
+        name_end = bang;
+    }
+    ph.name = begin;
+    ph.name_length = static_cast<size_t>(name_end - begin);
+
+    if (std::isdigit(static_cast<unsigned char>(*begin))) {
+        if (ph.name_length > 9 || (ph.name_length > 1 && *begin == '0')) {
+            return false;
+        }
+        for (const char* p = begin; p < name_end; ++p) {
+            if (!std::isdigit(static_cast<unsigned char>(*p))) {
+                return false;
+            }
+            ph.index = ph.index * 10 + static_cast<size_t>(*p - '0');
+        }
+        ph.positional = true;
+        return true;
+    }
+    ph.positional = false;
+    return true;
+}
+
+// ========== Type-Erased Formatting ==========
+
+template<typename Sink, typename T>
+void write_erased_value(Sink& sink, const T& value, const FormatSpec* spec) {
+    if (spec) {
+        append_formatted(sink, value, *spec);
+    } else {
+        append_default(sink, value);
+    }
+}
+
+/**
+ * @brief Write a packed argument; spec is null for a placeholder without one
+ */
+template<typename Sink>
+void write_format_arg(Sink& sink, const format_arg& arg, const FormatSpec* spec) {
+    switch (arg.tag) {
+    case format_arg::tag_none:
+        break;
+    case format_arg::tag_int:
+        write_erased_value(sink, *static_cast<const int*>(arg.value), spec);
+        break;
+    case format_arg::tag_long:
+        write_erased_value(sink, *static_cast<const long*>(arg.value), spec);
+        break;
+    case format_arg::tag_long_long:
+        write_erased_value(sink, *static_cast<const long long*>(arg.value), spec);
+        break;
+    case format_arg::tag_uint:
+        write_erased_value(sink, *static_cast<const unsigned int*>(arg.value), spec);
+        break;
+    case format_arg::tag_ulong:
+        write_erased_value(sink, *static_cast<const unsigned long*>(arg.value), spec);
+        break;
+    case format_arg::tag_ulong_long:
+        write_erased_value(sink, *static_cast<const unsigned long long*>(arg.value), spec);
+        break;
+    case format_arg::tag_float:
+        write_erased_value(sink, *static_cast<const float*>(arg.value), spec);
+        break;
+    case format_arg::tag_double:
+        write_erased_value(sink, *static_cast<const double*>(arg.value), spec);
+        break;
+    case format_arg::tag_bool:
+        write_erased_value(sink, *static_cast<const bool*>(arg.value), spec);
+        break;
+    case format_arg::tag_char:
+        write_erased_value(sink, *static_cast<const char*>(arg.value), spec);
+        break;
+    case format_arg::tag_string:
+        write_erased_value(sink, *static_cast<const std::string*>(arg.value), spec);
+        break;
+    case format_arg::tag_c_string:
+        write_erased_value(sink, *static_cast<const char* const*>(arg.value), spec);
+        break;
+    case format_arg::tag_char_array: {
+        const char* text = static_cast<const char*>(arg.value);
+        write_erased_value(sink, text, spec);
+        break;
+    }
+    case format_arg::tag_other: {
+        std::string text = arg.format(arg.value, spec);
+        sink.append(text.data(), text.length());
+        break;
+    }
+    }
+}
+
+} // namespace detail
+
+template<typename Sink>
+void format_context_base::write_arg(Sink& sink, const format_arg& arg, const FormatSpec* spec, escape_mode escape) const {
+    std::type_index type(*arg.type);
+    if (has_formatter_impl(type)) {
+        stats_.add(detail::stat_custom_formats);
+        std::string text = format_value_custom(type, arg.value, spec ? spec->format_string : std::string());
+        detail::append_escaped(sink, text.data(), text.length(), escape);
+    } else if (escape == escape_mode::none) {
+        detail::write_format_arg(sink, arg, spec);
+    } else {
+        detail::escaping_sink<Sink> escaped(sink, escape);
+        detail::write_format_arg(escaped, arg, spec);
+    }
+}
+
+template<typename Sink>
+void format_context_base::vformat_core(Sink& sink, escape_mode escape, const compiled_template& tmpl, format_args args) {
+    stats_.add(detail::stat_format_calls);
+    // Literal runs are copied in bulk, placeholders replaced in place with the specs
+    // parsed when the template was compiled. Substituted values are never scanned again.
+    const char* source = tmpl.source().data();
+    for (const auto& seg : tmpl.segments()) {
+        escape_mode value_escape = seg.has_escape ? seg.escape : escape;
+        switch (seg.kind) {
+        case compiled_template::segment_kind::literal:
+            sink.append(source + seg.offset, seg.length);
+            break;
+        case compiled_template::segment_kind::positional:
+            if (seg.index >= args.size()) {
+                sink.append(source + seg.offset, seg.length);
+            } else {
+                write_arg(sink, args[seg.index], seg.has_spec ? &seg.format : nullptr, value_escape);
+            }
+            break;
+        case compiled_template::segment_kind::named: {
+            // Use find_var for optimized lookup (single lock in shared_context)
+            auto found = find_var(seg.name);
+            stats_.add(detail::stat_var_lookups);
+            if (!found.first) {
+                sink.append(source + seg.offset, seg.length);
+                break;
+            }
+            stats_.add(detail::stat_var_hits);
+            if (!seg.spec.empty()) {
+                found.second = detail::apply_format(found.second, seg.format);
+            }
+            detail::append_escaped(sink, found.second.data(), found.second.length(), value_escape);
+            break;
+        }
+        }
+    }
+}
+
+UFMT_DECL std::string format_context_base::vformat(const std::string& template_str, format_args args) {
+    detail::profile_scope profile;
+    std::unique_ptr<compiled_template> uncached;
+    const compiled_template& tmpl = detail::cached_template(template_str, uncached);
+    profile.attach(tmpl);
+    std::string result;
+    result.reserve(template_str.size() + 16 * args.size());
+    vformat_core(result, default_escape_, tmpl, args);
+    stats_.add(detail::stat_bytes_formatted, result.size());
+    profile.finish(result.size());
+    return result;
+}
+
+UFMT_DECL void format_context_base::vformat_impl_to(std::string& sink, escape_mode escape, const std::string& template_str, format_args args) {
+    detail::profile_scope profile;
+    std::unique_ptr<compiled_template> uncached;
+    const compiled_template& tmpl = detail::cached_template(template_str, uncached);
+    profile.attach(tmpl);
+    size_t before = sink.size();
+    vformat_core(sink, escape, tmpl, args);
+    stats_.add(detail::stat_bytes_formatted, sink.size() - before);
+    profile.finish(sink.size() - before);
+}
+
+UFMT_DECL void format_context_base::vformat_impl_to(detail::sink_ref& sink, escape_mode escape, const std::string& template_str, format_args args) {
+    detail::profile_scope profile;
+    std::unique_ptr<compiled_template> uncached;
+    const compiled_template& tmpl = detail::cached_template(template_str, uncached);
+    profile.attach(tmpl);
+    size_t before = sink.written();
+    vformat_core(sink, escape, tmpl, args);
+    stats_.add(detail::stat_bytes_formatted, sink.written() - before);
+    profile.finish(sink.written() - before);
+}
+
+// ========== Compiled Templates and Contexts ==========
+
+UFMT_DECL bool context_base::is_main_thread() const {
+    // The first thread asking becomes the main thread
+    static const std::thread::id main_thread_id = std::this_thread::get_id();
+    return std::this_thread::get_id() == main_thread_id;
+}
+
+UFMT_DECL void compiled_template::parse() {
+    const char* base = source_.data();
+    detail::scan_template(base, source_.size(),
+        [this, base](const char* data, size_t size) {
+            segments_.push_back(segment{segment_kind::literal, static_cast<size_t>(data - base), size,
+                                        0, std::string(), std::string(), false, escape_mode::none, false,
+                                        FormatSpec()});
+        },
+        [this, base](const detail::placeholder_ref& ph, const char* open, size_t length) {
+            segment seg{ph.positional ? segment_kind::positional : segment_kind::named,
+                        static_cast<size_t>(open - base), length, ph.index,
+                        std::string(), std::string(ph.spec, ph.spec_length), ph.has_spec,
+                        ph.escape, ph.has_escape, detail::parse_format_spec(ph.spec, ph.spec_length)};
+            if (ph.positional) {
+                arg_count_ = std::max(arg_count_, ph.index + 1);
+            } else {
+                seg.name.assign(ph.name, ph.name_length);
+                ++named_count_;
+            }
+            segments_.push_back(std::move(seg));
+        });
+    detail::add_global_stat(detail::stat_templates_compiled);
+}
+
+namespace detail {
+
+UFMT_DECL const compiled_template& cached_template(const std::string& template_str,
+                                                   std::unique_ptr<compiled_template>& uncached) {
+    static thread_local std::unordered_map<std::string, compiled_template> cache;
+    std::unordered_map<std::string, compiled_template>::iterator it = cache.find(template_str);
+    if (it != cache.end()) {
+        add_global_stat(stat_template_cache_hits);
+        return it->second;
+    }
+    if (cache.size() >= UFMT_TEMPLATE_CACHE_SIZE) {
+        uncached.reset(new compiled_template(template_str));
+        return *uncached;
+    }
+    return cache.emplace(template_str, compiled_template(template_str)).first->second;
+}
+
+} // namespace detail
+
+UFMT_DECL void shared_context::clear_var(const std::string& name) {
+    if (is_main_thread()) {
+        // Main thread clears from shared storage
+        std::lock_guard<detail::context_mutex> lock(mutex_);
+        variables_.erase(name);
+    } else {
+        // Worker threads clear from thread-local storage
+        thread_variables().erase(name);
+    }
+}
+
+UFMT_DECL bool shared_context::has_var(const std::string& name) const {
+    // Check thread-local first (no lock needed)
+    if (thread_variables().find(name) != thread_variables().end()) {
+        return true;
+    }
+    
+    // Check shared storage (lock needed)
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    return variables_.find(name) != variables_.end();
+}
+
+UFMT_DECL std::string shared_context::get_var(const std::string& name) const {
+    // Check thread-local variables first (no lock needed)
+    auto thread_it = thread_variables().find(name);
+    if (thread_it != thread_variables().end()) {
+        return thread_it->second.text;
+    }
+    
+    // Fall back to shared variables (lock needed)
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    auto it = variables_.find(name);
+    return (it != variables_.end()) ? it->second.text : std::string();
+}
+
+UFMT_DECL void shared_context::set_typed_var(const std::string& name, const std::string& value, detail::var_kind kind) {
+    if (is_main_thread()) {
+        // Main thread writes to shared storage
+        std::lock_guard<detail::context_mutex> lock(mutex_);
+        variables_[name] = detail::var_value(value, kind);
+    } else {
+        // Worker threads write to thread-local storage
+        thread_variables()[name] = detail::var_value(value, kind);
+    }
+}
+
+UFMT_DECL void shared_context::visit_vars(const std::function<void(const std::string&, const detail::var_value&)>& visitor) const {
+    for (const auto& var : thread_variables()) {
+        visitor(var.first, var.second);
+    }
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    for (const auto& var : variables_) {
+        if (thread_variables().find(var.first) == thread_variables().end()) {
+            visitor(var.first, var.second);
+        }
+    }
+}
+
+UFMT_DECL bool shared_context::find_var(const std::string& name, std::string& value) const {
+    // Check thread-local variables first (no lock needed)
+    auto thread_it = thread_variables().find(name);
+    if (thread_it != thread_variables().end()) {
+        value = thread_it->second.text;
+        return true;
+    }
+    // Fall back to shared variables (lock needed)
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    auto it = variables_.find(name);
+    if (it != variables_.end()) {
+        value = it->second.text;
+        return true;
+    }
+    value.clear();
+    return false;
+}
+
+UFMT_DECL void shared_context::set_formatter_impl(std::type_index type, std::function<std::string(const void*)> formatter) {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    formatters_[type] = formatter;
+}
+
+UFMT_DECL void shared_context::clear_formatter_impl(std::type_index type) {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    formatters_.erase(type);
+}
+
+UFMT_DECL bool shared_context::has_formatter_impl(std::type_index type) const {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    return formatters_.find(type) != formatters_.end();
+}
+
+UFMT_DECL std::function<std::string(const void*)> shared_context::get_formatter_impl(std::type_index type) const {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    auto it = formatters_.find(type);
+    return (it != formatters_.end()) ? it->second : std::function<std::string(const void*)>();
+}
+
+UFMT_DECL std::pair<bool, std::string> shared_context::find_var(const std::string& name) const {
+    std::string value;
+    if (find_var(name, value)) {
+        return {true, value};
+    }
+    return {false, std::string()};
+}
+
+UFMT_DECL std::string shared_context::format_value_custom(std::type_index type, const void* value, const std::string& /* formatSpec */) const {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    auto it = formatters_.find(type);
+    if (it != formatters_.end()) {
+        return it->second(value);
+    }
+    return std::string();
+}
+
+UFMT_DECL void shared_context::add_storage_stats(format_stats& stats) const {
+    std::lock_guard<detail::context_mutex> lock(mutex_);
+    stats.var_bytes = detail::var_map_bytes(variables_);
+    stats.formatter_bytes = detail::hash_map_bytes(formatters_);
+}
+
+UFMT_DECL std::unordered_map<std::string, detail::var_value>& shared_context::thread_variables() {
+    static thread_local std::unordered_map<std::string, detail::var_value> variables;
+    return variables;
+}
+
+UFMT_DECL context_manager::registry& context_manager::contexts() {
+    static registry instance;
+    return instance;
+}
+
+UFMT_DECL std::shared_ptr<shared_context> context_manager::get_context(const std::string& name) {
+    registry& r = contexts();
+    std::lock_guard<detail::context_mutex> lock(r.mutex);
+    auto it = r.contexts.find(name);
+    if (it == r.contexts.end()) {
+        auto ctx = std::make_shared<shared_context>();
+        detail::set_mutex_name(ctx->mutex_, name);
+        r.contexts[name] = ctx;
+        return ctx;
+    }
+    return it->second;
+}
+
+UFMT_DECL void context_manager::remove_context(const std::string& name) {
+    registry& r = contexts();
+    std::lock_guard<detail::context_mutex> lock(r.mutex);
+    r.contexts.erase(name);
+}
+
+UFMT_DECL void context_manager::clear_all_contexts() {
+    registry& r = contexts();
+    std::lock_guard<detail::context_mutex> lock(r.mutex);
+    r.contexts.clear();
+}
+
+// ========== Runtime Statistics ==========
+
+#ifdef UFMT_ENABLE_STATS
+
+namespace detail {
+
+UFMT_DECL stat_registry& stats_registry() {
+    static stat_registry instance = {};
+    return instance;
+}
+
+UFMT_DECL thread_stat_state& thread_stats() {
+    static thread_local thread_stat_state state;
+    return state;
+}
+
+UFMT_DECL thread_stat_state::thread_stat_state() {
+    stat_registry& registry = stats_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    ordinal = registry.next_ordinal++;
+    registry.threads.push_back(&block);
+}
+
+UFMT_DECL thread_stat_state::~thread_stat_state() {
+    stat_registry& registry = stats_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    block.add_to(registry.retired);
+    registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &block));
+}
+
+} // namespace detail
+
+UFMT_DECL format_stats stats() {
+    detail::stat_registry& registry = detail::stats_registry();
+    unsigned long long totals[detail::stat_count] = {};
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (size_t i = 0; i < detail::stat_count; ++i) {
+            totals[i] = registry.retired[i];
+        }
+        for (const detail::stat_block* block : registry.threads) {
+            block->add_to(totals);
+        }
+    }
+    format_stats result;
+    detail::store_stats(totals, result);
+    return result;
+}
+
+#else
+
+UFMT_DECL format_stats stats() {
+    return format_stats();
+}
+
+#endif
+
+// ========== Lock Instrumentation ==========
+
+#ifdef UFMT_ENABLE_LOCK_STATS
+
+namespace detail {
+
+UFMT_DECL mutex_registry& lock_registry() {
+    static mutex_registry instance;
+    return instance;
+}
+
+UFMT_DECL instrumented_mutex::instrumented_mutex()
+    : acquisitions_(0), contended_(0), wait_ns_(0), hold_ns_(0), max_hold_ns_(0) {
+    mutex_registry& registry = lock_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.mutexes.push_back(this);
+}
+
+UFMT_DECL instrumented_mutex::~instrumented_mutex() {
+    mutex_registry& registry = lock_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.mutexes.erase(std::find(registry.mutexes.begin(), registry.mutexes.end(), this));
+}
+
+UFMT_DECL void instrumented_mutex::set_name(const std::string& name) {
+    std::lock_guard<std::mutex> lock(lock_registry().mutex);
+    name_ = name;
+}
+
+UFMT_DECL mutex_stats instrumented_mutex::stats() const {
+    std::lock_guard<std::mutex> lock(lock_registry().mutex);
+    return registered_stats();
+}
+
+UFMT_DECL mutex_stats instrumented_mutex::registered_stats() const {
+    mutex_stats result;
+    result.name = name_;
+    result.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+    result.contended = contended_.load(std::memory_order_relaxed);
+    result.wait_ns = wait_ns_.load(std::memory_order_relaxed);
+    result.hold_ns = hold_ns_.load(std::memory_order_relaxed);
+    result.max_hold_ns = max_hold_ns_.load(std::memory_order_relaxed);
+    return result;
+}
+
+} // namespace detail
+
+UFMT_DECL std::vector<mutex_stats> lock_stats() {
+    std::vector<mutex_stats> result;
+    {
+        // Holding the registry mutex keeps the listed mutexes alive
+        detail::mutex_registry& registry = detail::lock_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        result.reserve(registry.mutexes.size());
+        for (const detail::instrumented_mutex* mutex : registry.mutexes) {
+            result.push_back(mutex->registered_stats());
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const mutex_stats& a, const mutex_stats& b) {
+        return a.wait_ns > b.wait_ns;
+    });
+    return result;
+}
+
+#else
+
+UFMT_DECL std::vector<mutex_stats> lock_stats() {
+    return std::vector<mutex_stats>();
+}
+
+#endif
+
+// ========== Template Profiling ==========
+
+#ifdef UFMT_ENABLE_PROFILING
+
+namespace detail {
+
+struct profile_entry {
+    unsigned long long calls = 0;
+    unsigned long long compiled_calls = 0;
+    unsigned long long total_ns = 0;
+    unsigned long long max_ns = 0;
+    unsigned long long bytes = 0;
+
+    void add(const profile_entry& other) {
+        calls += other.calls;
+        compiled_calls += other.compiled_calls;
+        total_ns += other.total_ns;
+        max_ns = std::max(max_ns, other.max_ns);
+        bytes += other.bytes;
+    }
+};
+
+// Entry index of templates beyond UFMT_PROFILE_MAX_TEMPLATES
+const std::uint32_t profile_overflow_index = 0xFFFFFFFFu;
+
+typedef std::unordered_map<std::uint32_t, profile_entry> profile_table;
+
+/**
+ * @brief Profile table of one thread, keyed by entry index
+ *
+ * Written by its thread under its own mutex, which is only contended while
+ * profile_report() or profile_reset() reads it.
+ */
+struct thread_profile_state {
+    std::mutex mutex;
+    profile_table entries;
+    profile_entry overflow;  // Templates beyond UFMT_PROFILE_MAX_TEMPLATES
+
+    thread_profile_state();
+    ~thread_profile_state();
+
+    thread_profile_state(const thread_profile_state&) = delete;
+    thread_profile_state& operator=(const thread_profile_state&) = delete;
+};
+
+struct profile_registry {
+    std::mutex mutex;
+    std::atomic<std::uint32_t> generation;               // Advanced by profile_reset(), never 0
+    std::vector<thread_profile_state*> threads;
+    std::unordered_map<std::string, std::uint32_t> ids;  // Entry index of every tracked template
+    std::vector<const std::string*> texts;               // Template of every entry index
+    profile_table retired;                               // Tables of threads that have exited
+    profile_entry retired_overflow;
+
+    profile_registry() : generation(1) {}
+};
+
+UFMT_DECL profile_registry& profiles() {
+    static profile_registry instance;
+    return instance;
+}
+
+UFMT_DECL thread_profile_state& thread_profile() {
+    static thread_local thread_profile_state state;
+    return state;
+}
+
+UFMT_DECL thread_profile_state::thread_profile_state() {
+    profile_registry& registry = profiles();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.push_back(this);
+}
+
+UFMT_DECL thread_profile_state::~thread_profile_state() {
+    profile_registry& registry = profiles();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& entry : entries) {
+        registry.retired[entry.first].add(entry.second);
+    }
+    registry.retired_overflow.add(overflow);
+    registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+}
+
+// Slot key of a template, registering its text if new to the process; the overflow
+// index once the limit is reached. The caller holds registry.mutex.
+inline std::uint64_t register_profile_text(profile_registry& registry, const std::string& template_str) {
+    std::uint64_t generation = static_cast<std::uint64_t>(registry.generation.load(std::memory_order_relaxed)) << 32;
+    std::unordered_map<std::string, std::uint32_t>::iterator it = registry.ids.find(template_str);
+    if (it != registry.ids.end()) {
+        return generation | it->second;
+    }
+    if (registry.texts.size() >= UFMT_PROFILE_MAX_TEMPLATES) {
+        return generation | profile_overflow_index;
+    }
+    std::uint32_t index = static_cast<std::uint32_t>(registry.texts.size());
+    registry.texts.push_back(&registry.ids.emplace(template_str, index).first->first);
+    return generation | index;
+}
+
+inline void add_profile_call(profile_entry& entry, bool compiled, unsigned long long ns, size_t bytes) {
+    ++entry.calls;
+    entry.compiled_calls += compiled ? 1 : 0;
+    entry.total_ns += ns;
+    entry.max_ns = std::max(entry.max_ns, ns);
+    entry.bytes += bytes;
+}
+
+// Add a call under the entry a slot key names; false if the key is unset or from
+// before the last profile_reset(). The caller holds state.mutex.
+inline bool add_keyed_profile_call(thread_profile_state& state, const profile_registry& registry, std::uint64_t key,
+                                   bool compiled, unsigned long long ns, size_t bytes) {
+    if (static_cast<std::uint32_t>(key >> 32) != registry.generation.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    std::uint32_t index = static_cast<std::uint32_t>(key);
+    add_profile_call(index == profile_overflow_index ? state.overflow : state.entries[index], compiled, ns, bytes);
+    return true;
+}
+
+UFMT_DECL void record_profile(const profile_slot& slot, const std::string& template_str, bool compiled,
+                              unsigned long long ns, size_t bytes) {
+    profile_registry& registry = profiles();
+    thread_profile_state& state = thread_profile();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (add_keyed_profile_call(state, registry, slot.key.load(std::memory_order_relaxed), compiled, ns, bytes)) {
+            return;
+        }
+    }
+    // First call of this template object, or first since profile_reset(): find its
+    // entry by text. The registry is locked before the thread mutex, in the order of
+    // profile_report() and profile_reset(), so the generation cannot change until
+    // the call is added.
+    std::lock_guard<std::mutex> registry_lock(registry.mutex);
+    std::uint64_t key = register_profile_text(registry, template_str);
+    slot.key.store(key, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    add_keyed_profile_call(state, registry, key, compiled, ns, bytes);
+}
+
+inline template_profile make_template_profile(const std::string& template_str, const profile_entry& entry, bool overflow) {
+    template_profile result;
+    result.template_str = template_str;
+    result.calls = entry.calls;
+    result.compiled_calls = entry.compiled_calls;
+    result.total_ns = entry.total_ns;
+    result.max_ns = entry.max_ns;
+    result.bytes = entry.bytes;
+    result.overflow = overflow;
+    return result;
+}
+
+} // namespace detail
+
+UFMT_DECL std::vector<template_profile> profile_report(size_t n) {
+    std::vector<template_profile> result;
+    {
+        detail::profile_registry& registry = detail::profiles();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        detail::profile_table totals = registry.retired;
+        detail::profile_entry overflow = registry.retired_overflow;
+        for (detail::thread_profile_state* state : registry.threads) {
+            std::lock_guard<std::mutex> thread_lock(state->mutex);
+            for (const auto& entry : state->entries) {
+                totals[entry.first].add(entry.second);
+            }
+            overflow.add(state->overflow);
+        }
+        result.reserve(totals.size() + 1);
+        for (const auto& entry : totals) {
+            result.push_back(detail::make_template_profile(*registry.texts[entry.first], entry.second, false));
+        }
+        if (overflow.calls > 0) {
+            result.push_back(detail::make_template_profile(std::string(), overflow, true));
+        }
+    }
+    auto slower = [](const template_profile& a, const template_profile& b) { return a.total_ns > b.total_ns; };
+    if (n > 0 && n < result.size()) {
+        std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(n), result.end(), slower);
+        result.resize(n);
+    } else {
+        std::sort(result.begin(), result.end(), slower);
+    }
+    return result;
+}
+
+UFMT_DECL void profile_reset() {
+    detail::profile_registry& registry = detail::profiles();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    // Slots keyed with the old generation look their template up again
+    std::uint32_t generation = registry.generation.load(std::memory_order_relaxed) + 1;
+    registry.generation.store(generation != 0 ? generation : 1, std::memory_order_relaxed);
+    registry.ids.clear();
+    registry.texts.clear();
+    registry.retired.clear();
+    registry.retired_overflow = detail::profile_entry();
+    for (detail::thread_profile_state* state : registry.threads) {
+        std::lock_guard<std::mutex> thread_lock(state->mutex);
+        state->entries.clear();
+        state->overflow = detail::profile_entry();
+    }
+}
+
+#else
+
+UFMT_DECL std::vector<template_profile> profile_report(size_t /* n */) {
+    return std::vector<template_profile>();
+}
+
+UFMT_DECL void profile_reset() {}
+
+#endif
+
+} // namespace ufmt
+
+#endif // __UFMT_IMPL_H__
@@ -0,0 +1,284 @@
+/**
+ * @file ufmt_io.h
+ * @brief Batched output sinks for ufmt
+ *
+ * fd_sink accumulates formatted output in a chunked buffer and writes it to a
+ * file descriptor with a single vectored write (writev) once a size or time
+ * threshold is reached. It can be passed to any format_to() API.
+ *
+ * Usage:
+ * @code
+ * #include "ufmt/ufmt_io.h"
+ *
+ * ufmt::fd_sink out(STDOUT_FILENO, 64 * 1024, std::chrono::milliseconds(50));
+ * for (const auto& e : events) {
+ *     ufmt::format_to(out, "{0} {1:.3f}\n", e.name, e.value);
+ * }
+ * out.flush();
+ * @endcode
+ *
+ * @author Piotr Likus
+ * License: MIT
+ * @version 1.0
+ * @date 2025
+ */
+
+#ifndef __UFMT_IO_H__
+#define __UFMT_IO_H__
+
+#include "ufmt.h"
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+namespace ufmt {
+
+namespace detail {
+
+/**
+ * @brief Write the whole buffer to a file descriptor, retrying partial writes
+ * @return false on a write error
+ */
+inline bool write_fully(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        unsigned int chunk = static_cast<unsigned int>(std::min<size_t>(size, 0x7fffffff));
+        int written = _write(fd, data, chunk);
+        if (written < 0) {
+            return false;
+        }
+#else
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+#endif
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Write a list of buffers with writev, in batches of IOV_MAX, retrying partial writes
+ * @param iov Buffers to write; entries are modified while writing
+ * @param syscalls Incremented for each writev call
+ * @return false on a write error
+ */
+inline bool writev_fully(int fd, struct iovec* iov, size_t count, unsigned long long& syscalls) {
+#ifdef IOV_MAX
+    const size_t max_iov = IOV_MAX;
+#else
+    const size_t max_iov = 1024;
+#endif
+    while (count > 0) {
+        size_t batch = std::min(count, max_iov);
+        ++syscalls;
+        ssize_t written = ::writev(fd, iov, static_cast<int>(batch));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip fully written buffers, adjust a partially written one
+        size_t left = static_cast<size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+#endif
+
+} // namespace detail
+
+/**
+ * @brief Flush statistics of an fd_sink
+ * @ingroup core
+ */
+struct sink_stats {
+    unsigned long long flushes = 0;        ///< Flushes that wrote data
+    unsigned long long size_flushes = 0;   ///< Flushes triggered by the size threshold
+    unsigned long long time_flushes = 0;   ///< Flushes triggered by the time threshold
+    unsigned long long syscalls = 0;       ///< writev/write calls issued
+    unsigned long long bytes_written = 0;  ///< Bytes handed to the file descriptor
+    unsigned long long write_errors = 0;   ///< Failed write calls (buffered data is discarded)
+};
+
+/**
+ * @brief Output sink batching writes to a file descriptor with writev
+ * @ingroup core
+ *
+ * Appended data is copied into fixed-size chunks which are kept allocated
+ * between flushes. A flush hands all filled chunks to the kernel with one
+ * writev call (batches of IOV_MAX on very large buffers). A flush happens when
+ * the buffered size reaches flush_bytes, when flush_interval has elapsed since
+ * the previous flush (checked on append() and poll()), on flush() and on
+ * destruction. Not thread-safe; the file descriptor is not owned.
+ *
+ * On platforms without writev the chunks are written one by one.
+ */
+class fd_sink {
+public:
+    /**
+     * @brief Create a sink
+     * @param fd Destination file descriptor
+     * @param flush_bytes Buffered size triggering a flush
+     * @param flush_interval Maximum time data stays buffered (zero disables the time threshold)
+     * @param chunk_size Size of a single buffer chunk
+     */
+    explicit fd_sink(int fd, size_t flush_bytes = 64 * 1024,
+                     std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0),
+                     size_t chunk_size = 16 * 1024)
+        : fd_(fd), flush_bytes_(flush_bytes), flush_interval_(flush_interval),
+          chunk_size_(chunk_size > 0 ? chunk_size : 1), current_(0), current_fill_(0), buffered_(0),
+          last_flush_(std::chrono::steady_clock::now()) {}
+
+    ~fd_sink() {
+        flush();
+    }
+
+    fd_sink(const fd_sink&) = delete;
+    fd_sink& operator=(const fd_sink&) = delete;
+
+    /**
+     * @brief Append data, flushing if a threshold is reached
+     */
+    void append(const char* data, size_t size) {
+        while (size > 0) {
+            if (current_ == chunks_.size()) {
+                chunks_.emplace_back(new char[chunk_size_]);
+            }
+            size_t count = std::min(size, chunk_size_ - current_fill_);
+            std::memcpy(chunks_[current_].get() + current_fill_, data, count);
+            current_fill_ += count;
+            buffered_ += count;
+            data += count;
+            size -= count;
+            if (current_fill_ == chunk_size_) {
+                ++current_;
+                current_fill_ = 0;
+            }
+        }
+        if (buffered_ >= flush_bytes_) {
+            ++stats_.size_flushes;
+            flush();
+        } else {
+            poll();
+        }
+    }
+
+    /**
+     * @brief Append a single character
+     */
+    void push_back(char c) {
+        append(&c, 1);
+    }
+
+    /**
+     * @brief Flush if the time threshold has elapsed (for idle callers)
+     */
+    void poll() {
+        if (flush_interval_.count() > 0 && buffered_ > 0 &&
+            std::chrono::steady_clock::now() - last_flush_ >= flush_interval_) {
+            ++stats_.time_flushes;
+            flush();
+        }
+    }
+
+    /**
+     * @brief Write all buffered data
+     * @return false if a write error occurred
+     */
+    bool flush() {
+        last_flush_ = std::chrono::steady_clock::now();
+        if (buffered_ == 0) {
+            return true;
+        }
+        size_t used = current_ + (current_fill_ > 0 ? 1 : 0);
+        bool ok = write_chunks(used);
+        ++stats_.flushes;
+        if (ok) {
+            stats_.bytes_written += buffered_;
+        } else {
+            ++stats_.write_errors;
+        }
+        current_ = 0;
+        current_fill_ = 0;
+        buffered_ = 0;
+        return ok;
+    }
+
+    /**
+     * @brief Number of bytes waiting to be written
+     */
+    size_t buffered() const { return buffered_; }
+
+    /**
+     * @brief Flush statistics
+     */
+    const sink_stats& stats() const { return stats_; }
+
+private:
+    int fd_;
+    size_t flush_bytes_;
+    std::chrono::milliseconds flush_interval_;
+    size_t chunk_size_;
+    std::vector<std::unique_ptr<char[]>> chunks_;  // Kept allocated across flushes
+    size_t current_;       // Chunk being filled
+    size_t current_fill_;  // Bytes used in the current chunk
+    size_t buffered_;
+    std::chrono::steady_clock::time_point last_flush_;
+    sink_stats stats_;
+#ifndef _WIN32
+    std::vector<struct iovec> iov_;
+#endif
+
+    size_t chunk_length(size_t index) const {
+        return index < current_ ? chunk_size_ : current_fill_;
+    }
+
+#ifdef _WIN32
+    bool write_chunks(size_t used) {
+        for (size_t i = 0; i < used; ++i) {
+            ++stats_.syscalls;
+            if (!detail::write_fully(fd_, chunks_[i].get(), chunk_length(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+#else
+    bool write_chunks(size_t used) {
+        iov_.resize(used);
+        for (size_t i = 0; i < used; ++i) {
+            iov_[i].iov_base = chunks_[i].get();
+            iov_[i].iov_len = chunk_length(i);
+        }
+        return detail::writev_fully(fd_, iov_.data(), used, stats_.syscalls);
+    }
+#endif
+};
+
+} // namespace ufmt
+
+#endif // __UFMT_IO_H__
@@ -0,0 +1,422 @@
+/**
+ * @file ufmt_parallel.h
+ * @brief Parallel batch formatting for ufmt
+ *
+ * parallel_format_batch() splits a row range into chunks, formats the chunks on
+ * a work-stealing task_pool into private buffers and assembles the result in
+ * input order, either by appending the chunks to a sink or by handing them to
+ * writev.
+ *
+ * Usage:
+ * @code
+ * #include "ufmt/ufmt_parallel.h"
+ *
+ * static const auto tmpl = ufmt::compile("{0},{1},{2:.2f}\n");
+ * ufmt::task_pool pool(16);                       // reused across batches
+ * ufmt::chunked_output out;
+ * ufmt::parallel_format_batch(pool, *tmpl, rows, out);
+ * out.write_to(fd);                                // one writev for all chunks
+ * @endcode
+ *
+ * @author Piotr Likus
+ * License: MIT
+ * @version 1.0
+ * @date 2025
+ */
+
+#ifndef __UFMT_PARALLEL_H__
+#define __UFMT_PARALLEL_H__
+
+#include "ufmt.h"
+#include "ufmt_io.h"
+
+#include <exception>
+#include <deque>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+namespace ufmt {
+
+/**
+ * @brief Output of parallel_format_batch(): one batch_output per chunk, in input order
+ * @ingroup core
+ */
+class chunked_output {
+public:
+    /**
+     * @brief Chunks in input order
+     */
+    const std::vector<batch_output>& chunks() const { return chunks_; }
+
+    /**
+     * @brief Total number of rows
+     */
+    size_t rows() const {
+        size_t count = 0;
+        for (const auto& chunk : chunks_) {
+            count += chunk.size();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Total number of bytes
+     */
+    size_t bytes() const {
+        size_t count = 0;
+        for (const auto& chunk : chunks_) {
+            count += chunk.buffer().size();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Append all chunks to a sink, in order
+     */
+    template<typename Sink>
+    void append_to(Sink& sink) const {
+        for (const auto& chunk : chunks_) {
+            sink.append(chunk.buffer().data(), chunk.buffer().size());
+        }
+    }
+
+    /**
+     * @brief All chunks, concatenated
+     */
+    std::string str() const {
+        std::string result;
+        result.reserve(bytes());
+        append_to(result);
+        return result;
+    }
+
+    /**
+     * @brief Write all chunks to a file descriptor without concatenating them
+     * @return false on a write error
+     */
+    bool write_to(int fd) const {
+#ifdef _WIN32
+        for (const auto& chunk : chunks_) {
+            if (!detail::write_fully(fd, chunk.buffer().data(), chunk.buffer().size())) {
+                return false;
+            }
+        }
+        return true;
+#else
+        std::vector<struct iovec> iov;
+        iov.reserve(chunks_.size());
+        for (const auto& chunk : chunks_) {
+            if (!chunk.buffer().empty()) {
+                struct iovec entry;
+                entry.iov_base = const_cast<char*>(chunk.buffer().data());
+                entry.iov_len = chunk.buffer().size();
+                iov.push_back(entry);
+            }
+        }
+        unsigned long long syscalls = 0;
+        return detail::writev_fully(fd, iov.data(), iov.size(), syscalls);
+#endif
+    }
+
+    /**
+     * @brief Resize to a number of empty chunks, keeping their capacity
+     */
+    void reset(size_t chunk_count) {
+        chunks_.resize(chunk_count);
+        for (auto& chunk : chunks_) {
+            chunk.clear();
+        }
+    }
+
+    batch_output& chunk(size_t index) { return chunks_[index]; }
+
+private:
+    std::vector<batch_output> chunks_;
+};
+
+/**
+ * @brief Work-stealing thread pool for parallel formatting jobs
+ * @ingroup core
+ *
+ * run() executes a job of task_count independent tasks. Tasks are dealt out in
+ * contiguous blocks to per-worker deques; a worker takes tasks from the front
+ * of its own deque and, once it runs dry, steals from the back of the other
+ * deques, so expensive tasks on one worker do not leave the others idle. The
+ * calling thread acts as worker 0 while the job runs, so a pool of N threads
+ * starts N - 1 background threads.
+ *
+ * One job runs at a time; concurrent run() calls are serialized. Tasks must
+ * not call run() on the same pool.
+ */
+class task_pool {
+public:
+    /**
+     * @brief Start a pool
+     * @param threads Number of workers including the calling thread (0 = hardware concurrency)
+     */
+    explicit task_pool(size_t threads = 0)
+        : job_(nullptr), generation_(0), finished_(0), stopping_(false), steals_(0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            queues_.emplace_back(new worker_queue());
+        }
+        for (size_t i = 1; i < threads; ++i) {
+            threads_.emplace_back(&task_pool::worker_main, this, i);
+        }
+    }
+
+    ~task_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    task_pool(const task_pool&) = delete;
+    task_pool& operator=(const task_pool&) = delete;
+
+    /**
+     * @brief Number of workers including the calling thread
+     */
+    size_t thread_count() const { return queues_.size(); }
+
+    /**
+     * @brief Run fn(task, worker) for every task in [0, task_count) and wait for completion
+     *
+     * worker is in [0, thread_count()) and identifies the executing thread, e.g.
+     * to select per-worker state. The first exception thrown by a task is
+     * rethrown here after all tasks have finished.
+     */
+    void run(size_t task_count, const std::function<void(size_t, size_t)>& fn) {
+        if (task_count == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> run_lock(run_mutex_);
+        size_t workers = queues_.size();
+        for (size_t w = 0; w < workers; ++w) {
+            std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+            for (size_t task = task_count * w / workers; task < task_count * (w + 1) / workers; ++task) {
+                queues_[w]->tasks.push_back(task);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &fn;
+            error_ = std::exception_ptr();
+            finished_ = 0;
+            ++generation_;
+        }
+        wake_cv_.notify_all();
+        work(0);
+
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [this]() { return finished_ == threads_.size(); });
+            job_ = nullptr;
+            error = error_;
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Number of tasks executed by a worker other than the one they were dealt to
+     */
+    unsigned long long steal_count() const {
+        return steals_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(size_t, size_t)>* job_;
+    unsigned long long generation_;
+    size_t finished_;
+    bool stopping_;
+    std::exception_ptr error_;
+    std::atomic<unsigned long long> steals_;
+
+    void worker_main(size_t worker) {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_cv_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+                if (stopping_) {
+                    return;
+                }
+                seen = generation_;
+            }
+            work(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (++finished_ == threads_.size()) {
+                    done_cv_.notify_all();
+                }
+            }
+        }
+    }
+
+    // All tasks are queued before a job starts, so a worker finding every deque
+    // empty can leave; remaining tasks are already being executed elsewhere.
+    void work(size_t worker) {
+        size_t task;
+        while (pop_local(worker, task) || steal(worker, task)) {
+            try {
+                (*job_)(task, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+    }
+
+    bool pop_local(size_t worker, size_t& task) {
+        worker_queue& queue = *queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t worker, size_t& task) {
+        size_t workers = queues_.size();
+        for (size_t i = 1; i < workers; ++i) {
+            worker_queue& victim = *queues_[(worker + i) % workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                steals_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+namespace detail {
+
+// Rows per chunk below which splitting does not pay off
+const size_t parallel_min_chunk_rows = 256;
+// Chunks per worker, leaving room for stealing when row costs are skewed
+const size_t parallel_chunks_per_thread = 8;
+
+/**
+ * @brief Format [first, first + count) into out on a task pool
+ *
+ * The range is split into contiguous chunks, each formatted as one task into
+ * its own batch_output, so stolen chunks still end up in input order. Every
+ * worker uses its own copy of the plan.
+ */
+template<typename Plan, typename Iterator>
+void parallel_write_rows(task_pool& pool, const Plan& plan, Iterator first, size_t count, chunked_output& out) {
+    size_t chunk_count = std::min(pool.thread_count() * parallel_chunks_per_thread,
+                                  std::max<size_t>(1, count / parallel_min_chunk_rows));
+    out.reset(chunk_count);
+    if (chunk_count == 1) {
+        plan.write_rows(first, first + static_cast<std::ptrdiff_t>(count), out.chunk(0));
+        return;
+    }
+    std::vector<Plan> plans(pool.thread_count(), plan);
+    pool.run(chunk_count, [&](size_t chunk, size_t worker) {
+        size_t begin = count * chunk / chunk_count;
+        size_t end = count * (chunk + 1) / chunk_count;
+        plans[worker].write_rows(first + static_cast<std::ptrdiff_t>(begin),
+                                 first + static_cast<std::ptrdiff_t>(end), out.chunk(chunk));
+    });
+}
+
+} // namespace detail
+
+/**
+ * @brief Format one template over many rows on a task pool
+ * @ingroup core
+ * @param pool Work-stealing pool executing the chunks
+ * @param ctx Context whose variables and custom formatters are used; resolved
+ *            once on the calling thread, workers only see their own copy
+ * @param tmpl Compiled template; {i} refers to field i of a row
+ * @param rows Random-access range of std::tuple / std::pair rows, or a ufmt::columns() set
+ * @param out Receives the chunks in input order
+ *
+ * Output is identical to format_batch(). Small inputs are formatted on the
+ * calling thread only.
+ */
+template<typename Range>
+void parallel_format_batch(task_pool& pool, format_context_base& ctx, const compiled_template& tmpl,
+                           const Range& rows, chunked_output& out) {
+    typedef typename std::decay<decltype(*std::begin(rows))>::type row_type;
+    detail::profile_scope profile(tmpl);
+    detail::batch_plan<row_type, batch_output> plan(ctx, tmpl);
+    size_t count = static_cast<size_t>(std::distance(std::begin(rows), std::end(rows)));
+    detail::parallel_write_rows(pool, plan, std::begin(rows), count, out);
+    profile.finish(out.bytes());
+}
+
+/**
+ * @brief Format on a task pool, appending the result to a sink in order
+ */
+template<typename Range, typename Sink>
+void parallel_format_batch(task_pool& pool, format_context_base& ctx, const compiled_template& tmpl,
+                           const Range& rows, Sink& sink) {
+    chunked_output out;
+    parallel_format_batch(pool, ctx, tmpl, rows, out);
+    out.append_to(sink);
+}
+
+/**
+ * @brief Format on a task pool using the internal singleton context
+ */
+template<typename Range, typename Sink>
+void parallel_format_batch(task_pool& pool, const compiled_template& tmpl, const Range& rows, Sink& sink) {
+    parallel_format_batch(pool, detail::get_singleton_internal_context(), tmpl, rows, sink);
+}
+
+/**
+ * @brief Format one template over many rows on a temporary pool
+ * @param threads Number of threads including the caller (0 = hardware concurrency)
+ *
+ * Starts and stops threads on every call; keep a task_pool for repeated batches.
+ */
+template<typename Range, typename Sink>
+void parallel_format_batch(format_context_base& ctx, const compiled_template& tmpl, const Range& rows,
+                           Sink& sink, size_t threads = 0) {
+    task_pool pool(threads);
+    parallel_format_batch(pool, ctx, tmpl, rows, sink);
+}
+
+/**
+ * @brief Format on a temporary pool using the internal singleton context
+ */
+template<typename Range, typename Sink>
+void parallel_format_batch(const compiled_template& tmpl, const Range& rows, Sink& sink, size_t threads = 0) {
+    parallel_format_batch(detail::get_singleton_internal_context(), tmpl, rows, sink, threads);
+}
+
+} // namespace ufmt
+
+#endif // __UFMT_PARALLEL_H__
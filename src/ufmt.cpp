@@ -0,0 +1,42 @@
+/**
+ * @file ufmt.cpp
+ * @brief Compiled part of ufmt for UFMT_SEPARATE_COMPILATION builds
+ *
+ * Defines the non-template functions declared in ufmt.h and instantiates the
+ * formatting kernels for std::string output, which translation units using
+ * the library then link instead of compiling themselves.
+ *
+ * @author Piotr Likus
+ * License: MIT
+ * @version 1.0
+ * @date 2025
+ */
+
+#ifndef UFMT_SEPARATE_COMPILATION
+#define UFMT_SEPARATE_COMPILATION
+#endif
+#define UFMT_SOURCE
+
+#include "ufmt/ufmt.h"
+#include "ufmt/ufmt_impl.h"
+
+namespace ufmt {
+namespace detail {
+
+template void append_aligned<std::string>(std::string&, const char*, size_t, const FormatSpec&);
+template void append_double<std::string>(std::string&, double, const FormatSpec&);
+template void append_integer<std::string>(std::string&, unsigned long long, bool, const FormatSpec&);
+template void append_text_formatted<std::string>(std::string&, const char*, size_t, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const std::string&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const char* const&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const bool&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const char&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const double&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const long long&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const int&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const unsigned long long&, const FormatSpec&);
+template void append_formatted<std::string>(std::string&, const unsigned int&, const FormatSpec&);
+template void append_escaped<std::string>(std::string&, const char*, size_t, escape_mode);
+
+} // namespace detail
+} // namespace ufmt
@@ -1,4 +1,6 @@
 #include "../include/ufmt/ufmt.h"
+#include "../include/ufmt/ufmt_async.h"
+#include "../include/ufmt/ufmt_parallel.h"
 #include "../include/utest/utest.h"
 #include <thread>
 #include <vector>
@@ -6,6 +8,9 @@
 #include <chrono>
 #include <set>
 #include <mutex>
+#include <cstdio>
+#include <sstream>
+#include <tuple>
 
 // Test thread safety of shared contexts
 UTEST_FUNC_DEF(SharedContextThreadSafety) {
@@ -489,6 +494,254 @@ UTEST_FUNC_DEF(TransparentThreadLocalIsolation) {
     UTEST_ASSERT_STR_EQUALS(main_result, "Main thread: shared_value");
 }
 
+// Read back everything written to a temporary file
+static std::string read_temp_file(std::FILE* file) {
+    std::fflush(file);
+    std::fseek(file, 0, SEEK_SET);
+    std::string content;
+    char buffer[4096];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content.append(buffer, count);
+    }
+    return content;
+}
+
+// Test asynchronous logger with multiple producers
+UTEST_FUNC_DEF(AsyncLoggerMultipleProducers) {
+    const int num_threads = 4;
+    const int records_per_thread = 250;
+    
+    std::FILE* file = std::tmpfile();
+    UTEST_ASSERT_NOT_NULL(file);
+    
+    auto ctx = ufmt::get_shared_context("async_logger_test");
+    ctx->set_var("app", "svc");
+    static const auto tmpl = ufmt::compile("[{app}] T{0} #{1} v={2:.1f}");
+    
+    {
+        ufmt::async_logger logger(fileno(file), 64, ufmt::overflow_policy::block);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.emplace_back([i, records_per_thread, &logger, ctx]() {
+                for (int j = 0; j < records_per_thread; ++j) {
+                    logger.log(*ctx, *tmpl, i, j, j * 0.5);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        logger.flush();
+        UTEST_ASSERT_EQUALS(logger.written_count(), static_cast<unsigned long long>(num_threads * records_per_thread));
+        
+        // Variables are snapshotted when the record is captured
+        logger.log(*ctx, "[{app}] last {0}", "record");
+        ctx->set_var("app", "changed");
+    }
+    
+    std::string content = read_temp_file(file);
+    std::fclose(file);
+    
+    std::istringstream lines(content);
+    std::string line;
+    std::vector<int> per_thread(num_threads, 0);
+    int total = 0;
+    while (std::getline(lines, line)) {
+        ++total;
+        if (line == "[svc] last record") {
+            continue;
+        }
+        int thread_id = line[7] - '0';
+        UTEST_ASSERT_STR_CONTAINS(line, "[svc] T");
+        // Records of one producer keep their order
+        std::string expected = ufmt::format("[svc] T{0} #{1} v={2:.1f}", thread_id, per_thread[static_cast<size_t>(thread_id)],
+                                            per_thread[static_cast<size_t>(thread_id)] * 0.5);
+        UTEST_ASSERT_STR_EQUALS(line, expected);
+        ++per_thread[static_cast<size_t>(thread_id)];
+    }
+    UTEST_ASSERT_EQUALS(total, num_threads * records_per_thread + 1);
+}
+
+// Test asynchronous logger overflow accounting
+UTEST_FUNC_DEF(AsyncLoggerDropAndCount) {
+    const int num_records = 5000;
+    std::FILE* file = std::tmpfile();
+    UTEST_ASSERT_NOT_NULL(file);
+    
+    unsigned long long dropped = 0;
+    int accepted = 0;
+    {
+        ufmt::async_logger logger(fileno(file), 2, ufmt::overflow_policy::drop_and_count);
+        for (int i = 0; i < num_records; ++i) {
+            if (logger.log("record {0}", i)) {
+                ++accepted;
+            }
+        }
+        logger.flush();
+        dropped = logger.dropped_count();
+    }
+    
+    std::string content = read_temp_file(file);
+    std::fclose(file);
+    
+    int lines = static_cast<int>(std::count(content.begin(), content.end(), '\n'));
+    UTEST_ASSERT_EQUALS(lines, accepted);
+    UTEST_ASSERT_EQUALS(static_cast<unsigned long long>(accepted) + dropped, static_cast<unsigned long long>(num_records));
+}
+
+// Test that records accepted while the logger stops are written, and that an
+// idle consumer wakes up for a single record without flush()
+UTEST_FUNC_DEF(AsyncLoggerStopWhileLogging) {
+    const int num_threads = 4;
+    std::FILE* file = std::tmpfile();
+    UTEST_ASSERT_NOT_NULL(file);
+    
+    std::atomic<int> accepted(0);
+    unsigned long long written = 0;
+    {
+        ufmt::async_logger logger(fileno(file), 16, ufmt::overflow_policy::block);
+        for (int i = 0; i < 20; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            UTEST_ASSERT_TRUE(logger.log("idle {0}", i));
+            accepted.fetch_add(1);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (logger.written_count() < static_cast<unsigned long long>(i + 1) &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            UTEST_ASSERT_EQUALS(logger.written_count(), static_cast<unsigned long long>(i + 1));
+        }
+        
+        std::vector<std::thread> threads;
+        for (int i = 0; i < num_threads; ++i) {
+            threads.emplace_back([i, &logger, &accepted]() {
+                for (int j = 0; j < 20000; ++j) {
+                    if (logger.log("T{0} #{1}", i, j)) {
+                        accepted.fetch_add(1);
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        logger.stop();
+        for (auto& t : threads) {
+            t.join();
+        }
+        written = logger.written_count();
+    }
+    
+    std::string content = read_temp_file(file);
+    std::fclose(file);
+    
+    int lines = static_cast<int>(std::count(content.begin(), content.end(), '\n'));
+    UTEST_ASSERT_EQUALS(lines, accepted.load());
+    UTEST_ASSERT_EQUALS(written, static_cast<unsigned long long>(accepted.load()));
+}
+
+// Test parallel batch formatting keeps input order and matches format_batch()
+UTEST_FUNC_DEF(ParallelBatchFormatting) {
+    std::vector<std::tuple<int, std::string, double>> rows;
+    for (int i = 0; i < 10000; ++i) {
+        rows.emplace_back(i, "name" + std::to_string(i % 97), i * 0.25);
+    }
+    auto tmpl = ufmt::compile("{host},{0},{1:-8},{2:.2f},{1}\n");
+    
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("host", "db1");
+    ctx->set_formatter<std::string>([](const std::string& s) { return "<" + s + ">"; });
+    
+    std::string expected;
+    ctx->format_batch(*tmpl, rows, expected);
+    
+    const size_t thread_counts[] = {1, 3, 8};
+    for (size_t threads : thread_counts) {
+        ufmt::chunked_output out;
+        ufmt::parallel_format_batch(*ctx, *tmpl, rows, out, threads);
+        UTEST_ASSERT_TRUE(out.chunks().size() >= threads);
+        UTEST_ASSERT_EQUALS(out.rows(), rows.size());
+        UTEST_ASSERT_EQUALS(out.bytes(), expected.size());
+        UTEST_ASSERT_STR_EQUALS(out.str(), expected);
+    }
+    
+    // Sink overload, struct-of-arrays input, small inputs stay single-threaded
+    std::vector<int> ids = {1, 2, 3};
+    std::vector<std::string> names = {"a", "b", "c"};
+    std::string small;
+    ufmt::parallel_format_batch(*ufmt::compile("{0}={1};"), ufmt::columns(ids, names), small, 4);
+    UTEST_ASSERT_STR_EQUALS(small, "1=a;2=b;3=c;");
+    
+    // Chunks go to a file descriptor without concatenation
+    std::FILE* file = std::tmpfile();
+    UTEST_ASSERT_NOT_NULL(file);
+    ufmt::chunked_output out;
+    ufmt::parallel_format_batch(*ctx, *tmpl, rows, out, 4);
+    UTEST_ASSERT_TRUE(out.write_to(fileno(file)));
+    std::string content = read_temp_file(file);
+    std::fclose(file);
+    UTEST_ASSERT_STR_EQUALS(content, expected);
+}
+
+// Test work-stealing pool: all tasks run once, skewed work is redistributed
+UTEST_FUNC_DEF(TaskPoolWorkStealing) {
+    ufmt::task_pool pool(4);
+    UTEST_ASSERT_EQUALS(pool.thread_count(), 4u);
+    
+    const size_t task_count = 64;
+    std::vector<std::atomic<int>> runs(task_count);
+    for (auto& r : runs) {
+        r.store(0);
+    }
+    std::vector<std::atomic<int>> per_worker(pool.thread_count());
+    for (auto& w : per_worker) {
+        w.store(0);
+    }
+    // Tasks dealt to worker 0 are slow, the others must steal them
+    pool.run(task_count, [&](size_t task, size_t worker) {
+        if (task < task_count / 4) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        runs[task].fetch_add(1);
+        per_worker[worker].fetch_add(1);
+    });
+    for (const auto& r : runs) {
+        UTEST_ASSERT_EQUALS(r.load(), 1);
+    }
+    int total = 0;
+    for (const auto& w : per_worker) {
+        total += w.load();
+    }
+    UTEST_ASSERT_EQUALS(total, static_cast<int>(task_count));
+    UTEST_ASSERT_TRUE(pool.steal_count() > 0);
+    
+    // The pool is reusable and reports task exceptions on the caller
+    bool thrown = false;
+    try {
+        pool.run(8, [](size_t task, size_t /* worker */) {
+            if (task == 5) {
+                throw std::runtime_error("task failed");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    UTEST_ASSERT_TRUE(thrown);
+    
+    // Batches on a shared pool give the same output as format_batch()
+    std::vector<std::pair<int, std::string>> rows;
+    for (int i = 0; i < 5000; ++i) {
+        rows.emplace_back(i, std::string(static_cast<size_t>(i % 50 == 0 ? 500 : 3), 'x'));
+    }
+    auto tmpl = ufmt::compile("{0}:{1}\n");
+    std::string expected;
+    ufmt::format_batch(*tmpl, rows, expected);
+    for (int round = 0; round < 3; ++round) {
+        std::string out;
+        ufmt::parallel_format_batch(pool, *tmpl, rows, out);
+        UTEST_ASSERT_STR_EQUALS(out, expected);
+    }
+}
+
 int main() {
     UTEST_PROLOG();
     
@@ -501,6 +754,11 @@ int main() {
     UTEST_FUNC(TransparentThreadLocalBehavior);
     UTEST_FUNC(LocalContextIsolation);
     UTEST_FUNC(TransparentThreadLocalIsolation);
+    UTEST_FUNC(AsyncLoggerMultipleProducers);
+    UTEST_FUNC(AsyncLoggerDropAndCount);
+    UTEST_FUNC(AsyncLoggerStopWhileLogging);
+    UTEST_FUNC(ParallelBatchFormatting);
+    UTEST_FUNC(TaskPoolWorkStealing);
     
     UTEST_EPILOG();
     return 0;
@@ -1,5 +1,12 @@
 #include "../include/ufmt/ufmt.h"
+#include "../include/ufmt/ufmt_io.h"
 #include "../include/utest/utest.h"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <tuple>
+#include <limits>
 
 // Test basic formatting functionality
 UTEST_FUNC_DEF(BasicFormatting) {
@@ -210,6 +217,15 @@ std::ostream& operator<<(std::ostream& os, const Point& p) {
     return os;
 }
 
+// Trivially copyable type that refers to memory it does not own
+struct Name {
+    const char* text;
+};
+
+std::ostream& operator<<(std::ostream& os, const Name& n) {
+    return os << n.text;
+}
+
 UTEST_FUNC_DEF(CustomTypes) {
     auto ctx = ufmt::create_local_context();
     
@@ -434,6 +450,713 @@ UTEST_FUNC_DEF(ErrorHandling) {
     UTEST_ASSERT_STR_CONTAINS(result7, long_string);
 }
 
+// Test arena context reuse with bulk reset
+UTEST_FUNC_DEF(ArenaContextReset) {
+    auto ctx = ufmt::create_arena_context(4);
+    ctx->set_formatter<bool>([](bool b) { return b ? "YES" : "NO"; });
+    
+    // First request
+    ctx->set_var("user", "Alice");
+    ctx->set_var("id", 7);
+    auto result1 = ctx->format("Request from {user} ({id}), ok: {0}", true);
+    UTEST_ASSERT_STR_EQUALS(result1, "Request from Alice (7), ok: YES");
+    
+    // Reset drops variables but keeps formatters and capacity
+    size_t capacity = ctx->capacity();
+    ctx->reset();
+    UTEST_ASSERT_FALSE(ctx->has_var("user"));
+    UTEST_ASSERT_FALSE(ctx->has_var("id"));
+    UTEST_ASSERT_TRUE(ctx->has_formatter<bool>());
+    UTEST_ASSERT_EQUALS(ctx->capacity(), capacity);
+    
+    // Second request reuses the same instance
+    ctx->set_var("user", "Bob");
+    auto result2 = ctx->format("Request from {user} ({id})");
+    UTEST_ASSERT_STR_EQUALS(result2, "Request from Bob ({id})");
+    
+    // Overwrite, clear and re-set
+    ctx->set_var("user", "Carol");
+    ctx->clear_var("user");
+    UTEST_ASSERT_FALSE(ctx->has_var("user"));
+    ctx->set_var("user", "Dave");
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{user}"), "Dave");
+    
+    // Growing past the reserved capacity keeps all variables reachable
+    for (int i = 0; i < 100; ++i) {
+        ctx->set_var("var" + std::to_string(i), i);
+    }
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{var0} {var50} {var99} {user}"), "0 50 99 Dave");
+    
+    ctx->reset();
+    UTEST_ASSERT_FALSE(ctx->has_var("var50"));
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{var50}"), "{var50}");
+}
+
+// Test deferred formatting via captured records
+UTEST_FUNC_DEF(CaptureRecord) {
+    auto tmpl = ufmt::compile("Order {0} x{1} at {2:.2f} by {3} ({4}) {5}");
+    UTEST_ASSERT_EQUALS(tmpl->arg_count(), 6u);
+    
+    std::string trader = "Alice";
+    ufmt::format_record rec = ufmt::capture(*tmpl, "ORD-1", 100, 12.3456, trader, true, 'Z');
+    
+    // Source arguments may change or go away before formatting
+    trader = "changed";
+    
+    std::string expected = ufmt::format(tmpl->source(), "ORD-1", 100, 12.3456, "Alice", true, 'Z');
+    UTEST_ASSERT_STR_EQUALS(rec.str(), expected);
+    UTEST_ASSERT_STR_EQUALS(rec.str(), "Order ORD-1 x100 at 12.35 by Alice (true) Z");
+    
+    // Records are movable and can be formatted on another thread
+    ufmt::format_record moved = std::move(rec);
+    UTEST_ASSERT_TRUE(rec.empty());
+    std::string output;
+    std::thread worker([&moved, &output]() { moved.format_to(output); });
+    worker.join();
+    UTEST_ASSERT_STR_EQUALS(output, expected);
+    
+    // Format specs, unsigned and custom types behave like format()
+    Point p(3, 4);
+    auto rec2 = ufmt::capture("{0:08x}|{1:-6}|{2}|{3}|{4:^9}", 255u, "ab", p, short(-7), p);
+    UTEST_ASSERT_STR_EQUALS(rec2.str(), ufmt::format("{0:08x}|{1:-6}|{2}|{3}|{4:^9}", 255u, "ab", p, short(-7), p));
+    
+    // Missing arguments and named placeholders without a context are left as-is
+    auto rec3 = ufmt::capture("{0} {1} {name}", 1);
+    UTEST_ASSERT_STR_EQUALS(rec3.str(), "1 {1} {name}");
+    
+    // Context capture snapshots variables and applies custom formatters
+    auto ctx = ufmt::create_local_context();
+    ctx->set_formatter<bool>([](bool b) { return b ? "YES" : "NO"; });
+    ctx->set_var("user", "Bob");
+    ctx->set_var("score", 87.5);
+    auto rec4 = ctx->capture("{user}: {0} score {score:.1f} {missing}", true);
+    ctx->set_var("user", "Eve");
+    UTEST_ASSERT_STR_EQUALS(rec4.str(), "Bob: YES score 87.5 {missing}");
+    
+    // Large string payloads spill to the heap transparently
+    std::string big(1000, 'x');
+    auto rec5 = ufmt::capture("[{0}]", big);
+    UTEST_ASSERT_STR_EQUALS(rec5.str(), "[" + big + "]");
+    
+    // Types holding a pointer are converted at capture time, the pointed-to
+    // data may be gone by the time the record is formatted
+    int value = 42;
+    ufmt::format_record rec6;
+    {
+        std::string source = "transient";
+        rec6 = ufmt::capture("{0}|{1:-10}|{2}", Name{source.c_str()}, Name{source.c_str()}, &value);
+        source.assign(source.size(), 'Z');
+    }
+    UTEST_ASSERT_STR_EQUALS(rec6.str(), ufmt::format("transient|transient |{0}", &value));
+    
+    // The widest by-value type round-trips through the record
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture("{0:.2f}", 2.25L).str(), ufmt::format("{0:.2f}", 2.25L));
+}
+
+// Test batched fd sink with format_to
+UTEST_FUNC_DEF(FdSinkBatching) {
+    std::FILE* file = std::tmpfile();
+    UTEST_ASSERT_NOT_NULL(file);
+    
+    std::string expected;
+    {
+        // Small chunks so that a flush spans several iovecs
+        ufmt::fd_sink sink(fileno(file), 1024, std::chrono::milliseconds(0), 100);
+        for (int i = 0; i < 200; ++i) {
+            ufmt::format_to(sink, "line {0}: {1:.2f}\n", i, i * 0.25);
+            expected += ufmt::format("line {0}: {1:.2f}\n", i, i * 0.25);
+        }
+        auto ctx = ufmt::create_local_context();
+        ctx->set_var("name", "tail");
+        ctx->format_to(sink, "{name}\n");
+        expected += "tail\n";
+        
+        UTEST_ASSERT_TRUE(sink.stats().size_flushes > 0);
+        UTEST_ASSERT_TRUE(sink.stats().syscalls < 200);
+        UTEST_ASSERT_TRUE(sink.flush());
+        UTEST_ASSERT_EQUALS(sink.buffered(), 0u);
+        UTEST_ASSERT_EQUALS(sink.stats().bytes_written, static_cast<unsigned long long>(expected.size()));
+        UTEST_ASSERT_EQUALS(sink.stats().write_errors, 0u);
+        
+        // Time threshold flushes on the next append
+        ufmt::fd_sink timed(fileno(file), 1 << 20, std::chrono::milliseconds(20));
+        timed.append("x", 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        timed.append("y\n", 2);
+        expected += "xy\n";
+        UTEST_ASSERT_EQUALS(timed.stats().time_flushes, 1u);
+        UTEST_ASSERT_EQUALS(timed.buffered(), 0u);
+    }
+    
+    std::fflush(file);
+    std::fseek(file, 0, SEEK_SET);
+    std::string content;
+    char buffer[4096];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content.append(buffer, count);
+    }
+    std::fclose(file);
+    UTEST_ASSERT_STR_EQUALS(content, expected);
+    
+    // std::string works as a sink too
+    std::string out = "> ";
+    ufmt::format_to(out, "{0}+{1}", 1, 2);
+    UTEST_ASSERT_STR_EQUALS(out, "> 1+2");
+}
+
+UTEST_FUNC_DEF(BatchFormatting) {
+    auto tmpl = ufmt::compile("{0};{1};{2:.2f};{3}|");
+    std::vector<std::tuple<std::string, int, double, bool>> rows;
+    for (int i = 0; i < 50; ++i) {
+        rows.emplace_back("item" + std::to_string(i), i * 7 - 100, i / 3.0, i % 2 == 0);
+    }
+    
+    // Every row matches format() of the same template
+    std::string expected;
+    for (const auto& row : rows) {
+        expected += ufmt::format(tmpl->source(), std::get<0>(row), std::get<1>(row), std::get<2>(row), std::get<3>(row));
+    }
+    std::string out;
+    ufmt::format_batch(*tmpl, rows, out);
+    UTEST_ASSERT_STR_EQUALS(out, expected);
+    
+    // batch_output records row boundaries
+    ufmt::batch_output batch;
+    ufmt::format_batch(*tmpl, rows, batch);
+    UTEST_ASSERT_EQUALS(batch.size(), rows.size());
+    UTEST_ASSERT_STR_EQUALS(batch.buffer(), expected);
+    UTEST_ASSERT_STR_EQUALS(batch.row(0), "item0;-100;0.00;true|");
+    UTEST_ASSERT_STR_EQUALS(batch.row(49), "item49;243;16.33;false|");
+    
+    // Struct-of-arrays input, unmatched placeholders stay verbatim
+    std::vector<int> ids = {1, 2, 3};
+    std::vector<std::string> names = {"a", "bb", "ccc"};
+    std::vector<bool> flags = {true, false, true};
+    std::string soa;
+    ufmt::format_batch("[{0:03d} {1:-4} {2} {3}]", ufmt::columns(ids, names, flags), soa);
+    UTEST_ASSERT_STR_EQUALS(soa, "[001 a    true {3}][002 bb   false {3}][003 ccc  true {3}]");
+    
+    // Context variables are resolved once, custom formatters apply per field
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("host", "web1");
+    ctx->set_formatter<bool>([](bool b) { return b ? "Y" : "N"; });
+    std::vector<std::pair<int, bool>> pairs = {{1, true}, {2, false}};
+    std::string ctx_out;
+    ctx->format_batch("{host}:{0}={1} {missing}\n", pairs, ctx_out);
+    UTEST_ASSERT_STR_EQUALS(ctx_out, "web1:1=Y {missing}\nweb1:2=N {missing}\n");
+}
+
+UTEST_FUNC_DEF(BraceScanner) {
+    // Every scanner variant finds the same brace at every offset and block position
+    std::string text(200, 'a');
+    for (size_t brace = 0; brace <= text.size(); ++brace) {
+        std::string probe = text;
+        if (brace < probe.size()) {
+            probe[brace] = (brace % 2 == 0) ? '{' : '}';
+        }
+        const char* begin = probe.data();
+        const char* end = begin + probe.size();
+        for (size_t start = 0; start < 40; start += 7) {
+            const char* expected = ufmt::detail::find_brace_scalar(begin + start, end);
+            UTEST_ASSERT_TRUE(ufmt::detail::find_brace(begin + start, end) == expected);
+#ifdef UFMT_SIMD_SSE2
+            UTEST_ASSERT_TRUE(ufmt::detail::find_brace_sse2(begin + start, end) == expected);
+#endif
+#ifdef UFMT_SIMD_AVX2
+            if (ufmt::detail::cpu_has_avx2()) {
+                UTEST_ASSERT_TRUE(ufmt::detail::find_brace_avx2(begin + start, end) == expected);
+            }
+#endif
+#ifdef UFMT_SIMD_NEON
+            UTEST_ASSERT_TRUE(ufmt::detail::find_brace_neon(begin + start, end) == expected);
+#endif
+        }
+    }
+    
+    // Long template with sparse placeholders
+    std::string filler(20000, 'x');
+    std::string tmpl = "<p>" + filler + "{0}</p>" + filler + "{user}{1:05d}" + filler + "{}";
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("user", "bob");
+    std::string result = ctx->format(tmpl, "hello", 42);
+    UTEST_ASSERT_STR_EQUALS(result, "<p>" + filler + "hello</p>" + filler + "bob00042" + filler + "{}");
+    
+    // Substituted values are not scanned for placeholders again
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{0} {1}", "{1}", "{user}"), "{1} {user}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{ {0} }{x", 1), "{ 1 }{x");
+}
+
+// Context counting variable lookups
+class CountingContext : public ufmt::local_context {
+public:
+    mutable int lookups = 0;
+
+protected:
+    std::pair<bool, std::string> find_var(const std::string& name) const override {
+        ++lookups;
+        return ufmt::local_context::find_var(name);
+    }
+};
+
+UTEST_FUNC_DEF(EscapedBraces) {
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{{0}} = {0}", 5), "{0} = 5");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{{{0}}}", "x"), "{x}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("}}{{}}{{"), "}{}{");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("a}b{c"), "a}b{c");
+    
+    // JSON payloads: escaped braces never trigger variable lookups
+    CountingContext ctx;
+    ctx.set_var("user", "bob");
+    std::string json = ctx.format("{{\"user\": \"{user}\", \"n\": {0}, \"tags\": {{\"a\": 1}}}}", 3);
+    UTEST_ASSERT_STR_EQUALS(json, "{\"user\": \"bob\", \"n\": 3, \"tags\": {\"a\": 1}}");
+    UTEST_ASSERT_EQUALS(ctx.lookups, 1);
+    
+    // Compiled templates keep escaped text as literal segments
+    auto tmpl = ufmt::compile("{{{0}}}-{{name}}");
+    UTEST_ASSERT_EQUALS(tmpl->arg_count(), 1u);
+    UTEST_ASSERT_EQUALS(tmpl->named_count(), 0u);
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture(*tmpl, 7).str(), "{7}-{name}");
+    std::vector<std::tuple<int>> rows = {std::make_tuple(1), std::make_tuple(2)};
+    std::string batch;
+    ufmt::format_batch(*tmpl, rows, batch);
+    UTEST_ASSERT_STR_EQUALS(batch, "{1}-{name}{2}-{name}");
+}
+
+UTEST_FUNC_DEF(EscapingModes) {
+    // Per-placeholder modifiers
+    std::string json = ufmt::format("{{\"msg\": \"{0!json}\"}}", "say \"hi\"\\\n\tend\x01");
+    UTEST_ASSERT_STR_EQUALS(json, "{\"msg\": \"say \\\"hi\\\"\\\\\\n\\tend\\u0001\"}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("<b>{0!html}</b>", "a<b> & 'c' \"d\""),
+                            "<b>a&lt;b&gt; &amp; &#39;c&#39; &quot;d&quot;</b>");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0!csv},{1!csv},{2!csv}", "plain", "a,b", "say \"x\""),
+                            "plain,\"a,b\",\"say \"\"x\"\"\"");
+    
+    // Modifiers combine with format specs; unknown modifiers are literal text
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0!html:-6}]", "<a>"), "[&lt;a&gt;   ]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0!xml} {0}", "v"), "{0!xml} v");
+    
+    // Long values cross the vectorized blocks
+    std::string long_value(100, 'x');
+    long_value[37] = '<';
+    long_value[99] = '&';
+    std::string expected = long_value.substr(0, 37) + "&lt;" + long_value.substr(38, 61) + "&amp;";
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0!html}", long_value), expected);
+    
+    // Context-wide mode, !raw opts out; template text is never escaped
+    auto ctx = ufmt::create_local_context();
+    ctx->set_escape_mode(ufmt::escape_mode::json);
+    ctx->set_var("user", "bo\"b");
+    UTEST_ASSERT_STR_EQUALS(ctx->format("\"{user}\" {0} {0!raw}", "a\\b"), "\"bo\\\"b\" a\\\\b a\\b");
+    
+    // Captured records and batches use the same rules
+    auto tmpl = ufmt::compile("{0!csv};{user!html};{1}");
+    ctx->set_var("user", "<x>");
+    UTEST_ASSERT_STR_EQUALS(ctx->capture(*tmpl, "a,b", "q\"").str(), "\"a,b\";&lt;x&gt;;q\\\"");
+    std::vector<std::tuple<std::string, std::string>> rows = {std::make_tuple("1,2", "\n")};
+    std::string batch;
+    ctx->format_batch(*tmpl, rows, batch);
+    UTEST_ASSERT_STR_EQUALS(batch, "\"1,2\";&lt;x&gt;;\\n");
+}
+
+UTEST_FUNC_DEF(JsonLogLine) {
+    // Variables keep their type; message and string values are escaped
+    auto ctx = ufmt::create_arena_context();
+    ctx->set_var("user", "bo\"b");
+    ctx->set_var("status", 200);
+    ctx->set_var("ratio", 0.5);
+    ctx->set_var("cached", true);
+    ctx->set_var("code", std::string("007"));
+    UTEST_ASSERT_STR_EQUALS(ctx->format_json("{user} got {0}\n", "<ok>"),
+        "{\"message\":\"bo\\\"b got <ok>\\n\",\"user\":\"bo\\\"b\",\"status\":200,"
+        "\"ratio\":0.500000,\"cached\":true,\"code\":\"007\"}");
+    
+    // Non-finite numbers are quoted, escape modifiers apply inside the message
+    ctx->reset();
+    ctx->set_var("load", std::numeric_limits<double>::infinity());
+    std::string line;
+    ctx->format_json_to(line, "{0!html}", "a&b");
+    UTEST_ASSERT_STR_EQUALS(line, "{\"message\":\"a&amp;b\",\"load\":\"inf\"}");
+    
+    // Buffer reuse appends; shared context includes thread-local overrides once
+    line.clear();
+    auto shared = ufmt::create_shared_context();
+    shared->set_var("count", 3);
+    shared->format_json_to(line, "n={count}");
+    UTEST_ASSERT_STR_EQUALS(line, "{\"message\":\"n=3\",\"count\":3}");
+    std::string worker_line;
+    std::thread worker([&shared, &worker_line]() {
+        shared->set_var("count", "many");
+        worker_line = shared->format_json("n={count}");
+    });
+    worker.join();
+    UTEST_ASSERT_STR_EQUALS(worker_line, "{\"message\":\"n=many\",\"count\":\"many\"}");
+}
+
+UTEST_FUNC_DEF(Utf8Width) {
+    const std::string word = "gr\xC3\xBC\xC3\x9F";            // "grüß": 6 bytes, 4 code points
+    const std::string wide = "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E";  // 3 CJK characters, 6 columns
+    
+    // Default measures bytes
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:8}]", word), "[  " + word + "]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:.3}]", word), "[gr\xC3]");
+    
+    // U: code points
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:-U6}]", word), "[" + word + "  ]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:U.3}]", word), "[gr\xC3\xBC]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:^U7}]", wide), "[  " + wide + "  ]");
+    
+    // Long ASCII values go through the vectorized prefix check
+    std::string ascii(40, 'a');
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:U.10}", ascii), "aaaaaaa...");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:U.10}", ascii + word), "aaaaaaa...");
+    
+    // W: display columns
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:W8}]", wide), "[  " + wide + "]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:W.3}]", wide), "[\xE6\x97\xA5]");  // Second character does not fit
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:-W4}]", "e\xCC\x81"), "[e\xCC\x81   ]");  // Combining accent
+    
+    // The flag is part of the placeholder, so modes mix in one template and
+    // compiled templates and variables keep it
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:8}|{0:U8}|{1:W8}]", word, wide),
+                            "[  " + word + "|    " + word + "|  " + wide + "]");
+    auto tmpl = ufmt::compile("[{0:*<W8}]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture(*tmpl, wide).str(), "[" + wide + "**]");
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("city", wide);
+    UTEST_ASSERT_STR_EQUALS(ctx->format("[{city:W8}]"), "[  " + wide + "]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:W<6}]", "ab"), "[abWWWW]");  // W before an alignment is a fill
+}
+
+UTEST_FUNC_DEF(FillAndAlign) {
+    // Custom fill characters with every alignment
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:*^9}", "abc"), "***abc***");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:.<6}|{0:_>6}|{0:=-6}", "ab"), "ab....|____ab|ab====");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:<5}][{0:>5}]", true), "[true ][ true]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#^12.7}", "truncate me"), "##trun...###");
+    
+    // Wider than the internal fill block
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:->40}", "x"), std::string(39, '-') + "x");
+    
+    // Named numeric values keep the fill
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("score", 95.7);
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{score:*^8.1f}"), "**95.7**");
+    
+    // Captured records and batches write padding directly; CSV quoting still covers the whole field
+    auto tmpl = ufmt::compile("{0:~<5}|{1!csv:-6}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture(*tmpl, "ab", "a,b").str(), "ab~~~|\"a,b   \"");
+    std::vector<std::tuple<std::string, const char*>> rows = {std::make_tuple("ab", "a,b")};
+    std::string batch;
+    ufmt::format_batch(*tmpl, rows, batch);
+    UTEST_ASSERT_STR_EQUALS(batch, "ab~~~|\"a,b   \"");
+}
+
+UTEST_FUNC_DEF(ParsedFormatSpec) {
+    ufmt::FormatSpec spec = ufmt::detail::parse_format_spec("*^+#012.3lld");
+    UTEST_ASSERT_EQUALS(spec.fill, '*');
+    UTEST_ASSERT_EQUALS(spec.align, '^');
+    UTEST_ASSERT_EQUALS(spec.sign, '+');
+    UTEST_ASSERT_TRUE(spec.alternate);
+    UTEST_ASSERT_TRUE(spec.zero_pad);
+    UTEST_ASSERT_EQUALS(spec.width, 12);
+    UTEST_ASSERT_EQUALS(spec.precision, 3);
+    UTEST_ASSERT_EQUALS(spec.format_type, 'd');
+    
+    spec = ufmt::detail::parse_format_spec("-10");
+    UTEST_ASSERT_TRUE(spec.left_justify);
+    UTEST_ASSERT_EQUALS(spec.width, 10);
+    UTEST_ASSERT_EQUALS(spec.precision, -1);
+    UTEST_ASSERT_EQUALS(spec.format_type, '\0');
+    UTEST_ASSERT_TRUE(spec.width_unit == ufmt::width_mode::bytes);
+    
+    spec = ufmt::detail::parse_format_spec("*>W20.5");
+    UTEST_ASSERT_TRUE(spec.width_unit == ufmt::width_mode::columns);
+    UTEST_ASSERT_EQUALS(spec.width, 20);
+    UTEST_ASSERT_EQUALS(spec.precision, 5);
+    UTEST_ASSERT_EQUALS(spec.format_type, '\0');
+    
+    // Positional arguments get the same alignment rules as named variables
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:^8.2f}]", 95.7), "[ 95.70  ]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:^6d}][{0:-6x}]", 255), "[ 255  ][ff    ]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#x} {0:#o} {0:+d} {0:.5d}", 8), "0x8 010 +8 00008");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:08.3f} {1:08d}", -9.5, -42), "-009.500 -0000042");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:d} {1:.1f}", 3.99, 7), "3 7.0");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0}", 18446744073709551615ULL), "18446744073709551615");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:x}", 18446744073709551615ULL), "ffffffffffffffff");
+    
+    // Negative values print as two's complement of their own width for x/X/o/u, like printf
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:x} {0:X} {0:o} {0:u} {0:d}", -7),
+                            "fffffff9 FFFFFFF9 37777777771 4294967289 -7");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:x} {0:u}", -7LL), "fffffffffffffff9 18446744073709551609");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#x}", -1), "0xffffffff");
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture("{0:x} {1:u}", -7, -7LL).str(), "fffffff9 18446744073709551609");
+    
+    // Compiled templates reuse the parsed spec for every row
+    auto tmpl = ufmt::compile("{0:>6.1f}|{1:*<4}");
+    std::vector<std::tuple<double, int>> rows = {std::make_tuple(1.25, 7), std::make_tuple(-2.0, 42)};
+    std::string out;
+    ufmt::format_batch(*tmpl, rows, out);
+    UTEST_ASSERT_STR_EQUALS(out, "   1.2|7***  -2.0|42**");
+}
+
+UTEST_FUNC_DEF(BinaryFormatting) {
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b}", 0), "0");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b}", 1), "1");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b}", 0x1FF), "111111111");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#b}", 0x8000000000000001ULL),
+                            "0b1000000000000000000000000000000000000000000000000000000000000001");
+    
+    // '#' adds the prefix as for x/o (not to zero), width, zero padding, grouping by 4
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#b} {0:#B} {0:#x} {0:#o}", 10), "0b1010 0B1010 0xa 012");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#b} {0:#x}", 0), "0 0");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:#012b}", 5), "0b0000000101");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:08b}", 5), "00000101");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:-6b}]", 5), "[101   ]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:_b}", 0xA5F0), "1010_0101_1111_0000");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:09_b}", 5), "0000_0101");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:_x} {0:_d}", 1234567), "12_d687 1_234_567");
+    
+    // Sign and magnitude for negative values, explicit sign option
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b} {0:#b} {0:#08b}", -5), "-101 -0b101 -0b00101");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b}", -5LL), "-101");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:+#b} {0: #b}", 5), "+0b101  0b101");
+    
+    // Every bit width round-trips
+    for (unsigned bits = 1; bits <= 64; ++bits) {
+        unsigned long long value = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:b}", value), std::string(bits, '1'));
+    }
+}
+
+UTEST_FUNC_DEF(GroupingAndSign) {
+    // Thousands separators without a locale
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:,d}", 1234567), "1,234,567");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:_d}", 1234567), "1_234_567");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:,} {1:,d} {2:,d}", 999, -1000, 0), "999 -1,000 0");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:>10,d}][{0:010,d}]", 1234567), "[ 1,234,567][01,234,567]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:,d}", 18446744073709551615ULL), "18,446,744,073,709,551,615");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:,.2f}", 1234567.891), "1,234,567.89");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0:*^14,.1f}]", -9876.54), "[***-9,876.5***]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:,.3e}", 12345.0), "1.234e+04");
+    
+    // Explicit signs
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:+.2f} {1:+.2f}", 3.14159, -3.14159), "+3.14 -3.14");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("[{0: d}][{1: d}]", 42, -42), "[ 42][-42]");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:+,d}", 1000000), "+1,000,000");
+    UTEST_ASSERT_STR_EQUALS(ufmt::format("{0:+,.2f}", 1234.5), "+1,234.50");
+    
+    // Named variables and compiled templates use the same kernels
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("total", 2500000.5);
+    UTEST_ASSERT_STR_EQUALS(ctx->format("{total:,.1f}"), "2,500,000.5");
+    auto tmpl = ufmt::compile("{0:,d}|{1:+.1f}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::capture(*tmpl, 1234, 0.25).str(), "1,234|+0.2");
+}
+
+UTEST_FUNC_DEF(PackedArguments) {
+    // vformat() with make_format_args() matches the variadic overloads
+    std::string name = "disk";
+    const char* unit = "GB";
+    char mutable_unit[] = "MB";
+    char* unit_ptr = mutable_unit;
+    UTEST_ASSERT_STR_EQUALS(ufmt::vformat("{0}: {1:.1f} {2} / {3} {4}", ufmt::make_format_args(name, 12.25, unit, "free", unit_ptr)),
+                            ufmt::format("{0}: {1:.1f} {2} / {3} {4}", name, 12.25, unit, "free", unit_ptr));
+    UTEST_ASSERT_STR_EQUALS(ufmt::vformat("{0} {1} {2} {3} {4} {5}", ufmt::make_format_args(-1L, 2u, 3ULL, 1.5f, 'c', false)),
+                            "-1 2 3 1.500000 c false");
+    UTEST_ASSERT_STR_EQUALS(ufmt::vformat("{0:>8}|{1}", ufmt::make_format_args(short(255), Point(1, 2))), "     255|(1, 2)");
+    UTEST_ASSERT_STR_EQUALS(ufmt::vformat("{0} {1}", ufmt::make_format_args(7)), "7 {1}");
+    UTEST_ASSERT_STR_EQUALS(ufmt::vformat("none", ufmt::format_args()), "none");
+    
+    std::string out = "> ";
+    ufmt::vformat_to(out, "{0}={1:03d}", ufmt::make_format_args("id", 7));
+    UTEST_ASSERT_STR_EQUALS(out, "> id=007");
+    
+    // Custom formatters and escaping apply to packed arguments as well
+    auto ctx = ufmt::create_local_context();
+    ctx->set_formatter<bool>([](bool b) { return b ? "YES" : "NO"; });
+    ctx->set_escape_mode(ufmt::escape_mode::html);
+    UTEST_ASSERT_STR_EQUALS(ctx->vformat("<b>{0}</b> {1} {1!raw}", ufmt::make_format_args(true, "a&b")),
+                            "<b>YES</b> a&amp;b a&b");
+    std::string csv;
+    ctx->vformat_to(csv, "{0!csv},{1!csv}", ufmt::make_format_args(std::string("x,y"), 2));
+    UTEST_ASSERT_STR_EQUALS(csv, "\"x,y\",2");
+}
+
+UTEST_FUNC_DEF(RuntimeStats) {
+    ufmt::format_stats before = ufmt::stats();
+    auto ctx = ufmt::create_local_context();
+    ctx->set_var("user", "ann");
+    ctx->set_formatter<bool>([](bool b) { return b ? "YES" : "NO"; });
+    std::string line = ctx->format("{user} {missing} {0} {1}", true, 5);
+    UTEST_ASSERT_STR_EQUALS(line, "ann {missing} YES 5");
+    auto tmpl = ufmt::compile("{0}:{user}");
+    ctx->capture(*tmpl, 1);
+    std::vector<std::tuple<int>> rows = {std::make_tuple(1), std::make_tuple(2), std::make_tuple(3)};
+    std::string batch;
+    ctx->format_batch(*tmpl, rows, batch);
+    std::thread worker([]() { ufmt::format("{0}", 1); });
+    worker.join();
+    ctx->format("{user} {missing} {0} {1}", false, 6);
+    
+    ufmt::format_stats local = ctx->stats();
+    ufmt::format_stats global = ufmt::stats();
+    UTEST_ASSERT_TRUE(local.var_bytes > 0);
+    UTEST_ASSERT_TRUE(local.formatter_bytes > 0);
+    if (ufmt::stats_enabled()) {
+        UTEST_ASSERT_EQUALS(local.format_calls, 2ULL);
+        UTEST_ASSERT_EQUALS(local.bytes_formatted, static_cast<unsigned long long>(2 * line.size() - 1));
+        UTEST_ASSERT_EQUALS(local.var_lookups, 6ULL);
+        UTEST_ASSERT_EQUALS(local.var_hits, 4ULL);
+        UTEST_ASSERT_EQUALS(local.var_misses(), 2ULL);
+        UTEST_ASSERT_EQUALS(local.custom_formats, 2ULL);
+        UTEST_ASSERT_EQUALS(local.captures, 1ULL);
+        UTEST_ASSERT_EQUALS(local.batch_rows, 3ULL);
+        // Includes the exited worker thread
+        UTEST_ASSERT_EQUALS(global.format_calls - before.format_calls, 3ULL);
+        // compile() and the first format() of each template on each thread; the repeated call is a cache hit
+        UTEST_ASSERT_EQUALS(global.templates_compiled - before.templates_compiled, 3ULL);
+        UTEST_ASSERT_EQUALS(global.template_cache_hits - before.template_cache_hits, 1ULL);
+    } else {
+        UTEST_ASSERT_EQUALS(local.format_calls, 0ULL);
+        UTEST_ASSERT_EQUALS(global.format_calls, 0ULL);
+    }
+}
+
+struct SlowValue {};
+
+UTEST_FUNC_DEF(LockStats) {
+    auto ctx = ufmt::get_shared_context("lock_stats_test");
+    std::atomic<bool> entered(false);
+    // Custom formatters run under the context mutex
+    ctx->set_formatter<SlowValue>([&entered](const SlowValue&) {
+        entered = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return std::string("slow");
+    });
+    std::thread holder([&ctx]() { ctx->format("{0}", SlowValue()); });
+    while (!entered) {
+        std::this_thread::yield();
+    }
+    bool has = ctx->has_formatter<int>();  // Waits for the formatter to finish
+    holder.join();
+    UTEST_ASSERT_FALSE(has);
+    
+    ufmt::mutex_stats own = ctx->lock_stats();
+    std::vector<ufmt::mutex_stats> all = ufmt::lock_stats();
+    if (ufmt::lock_stats_enabled()) {
+        UTEST_ASSERT_STR_EQUALS(own.name, "lock_stats_test");
+        UTEST_ASSERT_TRUE(own.acquisitions >= 3);
+        UTEST_ASSERT_TRUE(own.contended >= 1);
+        UTEST_ASSERT_TRUE(own.wait_ns > 0);
+        UTEST_ASSERT_TRUE(own.max_hold_ns >= 20000000ULL);
+        UTEST_ASSERT_TRUE(own.hold_ns >= own.max_hold_ns);
+        bool found_context = false;
+        bool found_manager = false;
+        for (const auto& entry : all) {
+            found_context = found_context || entry.name == "lock_stats_test";
+            found_manager = found_manager || (entry.name == "context_manager" && entry.acquisitions > 0);
+        }
+        UTEST_ASSERT_TRUE(found_context);
+        UTEST_ASSERT_TRUE(found_manager);
+    } else {
+        UTEST_ASSERT_EQUALS(own.acquisitions, 0ULL);
+        UTEST_ASSERT_TRUE(all.empty());
+    }
+    ufmt::context_manager::remove_context("lock_stats_test");
+}
+
+UTEST_FUNC_DEF(TemplateProfile) {
+    ufmt::profile_reset();
+    for (int i = 0; i < 3; ++i) {
+        ufmt::format("prof {0}", i);
+    }
+    std::thread worker([]() { ufmt::format("prof {0}", 42); });  // Reported after the thread exits
+    worker.join();
+    auto record_tmpl = ufmt::compile("prof record {0}");
+    std::string record_out = ufmt::capture(*record_tmpl, 7).str();
+    auto batch_tmpl = ufmt::compile("prof batch {0};");
+    std::vector<std::tuple<int>> rows = {std::make_tuple(1), std::make_tuple(2)};
+    std::string batch_out;
+    ufmt::format_batch(*batch_tmpl, rows, batch_out);
+    
+    std::vector<ufmt::template_profile> report = ufmt::profile_report();
+    if (!ufmt::profiling_enabled()) {
+        UTEST_ASSERT_TRUE(report.empty());
+        return;
+    }
+    UTEST_ASSERT_EQUALS(report.size(), 3U);
+    for (size_t i = 1; i < report.size(); ++i) {
+        UTEST_ASSERT_TRUE(report[i - 1].total_ns >= report[i].total_ns);
+    }
+    for (const auto& entry : report) {
+        UTEST_ASSERT_FALSE(entry.overflow);
+        UTEST_ASSERT_TRUE(entry.max_ns <= entry.total_ns);
+        if (entry.template_str == "prof {0}") {
+            UTEST_ASSERT_EQUALS(entry.calls, 4ULL);
+            UTEST_ASSERT_EQUALS(entry.compiled_calls, 0ULL);
+            UTEST_ASSERT_EQUALS(entry.bytes, 4ULL * 6 + 1);
+        } else if (entry.template_str == "prof record {0}") {
+            UTEST_ASSERT_EQUALS(entry.calls, 1ULL);
+            UTEST_ASSERT_EQUALS(entry.compiled_calls, 1ULL);
+            UTEST_ASSERT_EQUALS(entry.bytes, static_cast<unsigned long long>(record_out.size()));
+        } else {
+            UTEST_ASSERT_STR_EQUALS(entry.template_str, "prof batch {0};");
+            UTEST_ASSERT_EQUALS(entry.calls, 1ULL);
+            UTEST_ASSERT_EQUALS(entry.bytes, static_cast<unsigned long long>(batch_out.size()));
+        }
+    }
+    UTEST_ASSERT_EQUALS(ufmt::profile_report(1).size(), 1U);
+    ufmt::profile_reset();
+    UTEST_ASSERT_TRUE(ufmt::profile_report().empty());
+    
+    // Templates beyond the limit share one entry until a reset frees the stored texts
+    const int max_templates = UFMT_PROFILE_MAX_TEMPLATES;
+    for (int i = 0; i < max_templates + 3; ++i) {
+        ufmt::format("prof " + std::to_string(i) + " {0}", i);
+    }
+    ufmt::format("prof " + std::to_string(max_templates) + " {0}", 0);
+    report = ufmt::profile_report();
+    UTEST_ASSERT_EQUALS(report.size(), static_cast<size_t>(max_templates) + 1);
+    size_t overflow_entries = 0;
+    for (const auto& entry : report) {
+        if (entry.overflow) {
+            ++overflow_entries;
+            UTEST_ASSERT_EQUALS(entry.calls, 4ULL);
+        }
+    }
+    UTEST_ASSERT_EQUALS(overflow_entries, 1U);
+    ufmt::profile_reset();
+    ufmt::format("prof late {0}", 1);
+    report = ufmt::profile_report();
+    UTEST_ASSERT_EQUALS(report.size(), 1U);
+    UTEST_ASSERT_FALSE(report[0].overflow);
+    UTEST_ASSERT_STR_EQUALS(report[0].template_str, "prof late {0}");
+    
+    // Template objects with equal texts share an entry; a template compiled before a
+    // reset finds its entry again after it
+    auto copy_tmpl = ufmt::compile("prof late {0}");
+    ufmt::capture(*copy_tmpl, 2).str();
+    ufmt::capture(*copy_tmpl, 3).str();
+    ufmt::profile_reset();
+    ufmt::capture(*record_tmpl, 8).str();
+    ufmt::capture(*copy_tmpl, 4).str();
+    ufmt::format("prof late {0}", 5);
+    report = ufmt::profile_report();
+    UTEST_ASSERT_EQUALS(report.size(), 2U);
+    for (const auto& entry : report) {
+        UTEST_ASSERT_FALSE(entry.overflow);
+        if (entry.template_str == "prof late {0}") {
+            UTEST_ASSERT_EQUALS(entry.calls, 2ULL);
+            UTEST_ASSERT_EQUALS(entry.compiled_calls, 1ULL);
+        } else {
+            UTEST_ASSERT_STR_EQUALS(entry.template_str, "prof record {0}");
+            UTEST_ASSERT_EQUALS(entry.calls, 1ULL);
+        }
+    }
+    ufmt::profile_reset();
+}
+
 int main() {
     UTEST_PROLOG();
     
@@ -454,6 +1177,23 @@ int main() {
     UTEST_FUNC(CenterJustification);
     UTEST_FUNC(StringTruncation);
     UTEST_FUNC(ErrorHandling);
+    UTEST_FUNC(ArenaContextReset);
+    UTEST_FUNC(CaptureRecord);
+    UTEST_FUNC(FdSinkBatching);
+    UTEST_FUNC(BatchFormatting);
+    UTEST_FUNC(BraceScanner);
+    UTEST_FUNC(EscapedBraces);
+    UTEST_FUNC(EscapingModes);
+    UTEST_FUNC(JsonLogLine);
+    UTEST_FUNC(Utf8Width);
+    UTEST_FUNC(FillAndAlign);
+    UTEST_FUNC(ParsedFormatSpec);
+    UTEST_FUNC(BinaryFormatting);
+    UTEST_FUNC(GroupingAndSign);
+    UTEST_FUNC(PackedArguments);
+    UTEST_FUNC(RuntimeStats);
+    UTEST_FUNC(LockStats);
+    UTEST_FUNC(TemplateProfile);
     
     UTEST_EPILOG();
     return 0;